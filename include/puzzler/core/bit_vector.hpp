@@ -0,0 +1,112 @@
+#ifndef puzzler_core_bit_vector_hpp
+#define puzzler_core_bit_vector_hpp
+
+#include <cstdint>
+#include <vector>
+#include <stdexcept>
+
+namespace puzzler{
+
+  /*! A fixed-length sequence of bits, packed 64 to a word with bit i in word
+      i/64 at position i%64. Unlike std::vector<bool> the words are exposed,
+      so code working on whole words (and persistence) needn't go bit by bit.
+      Bits past size() in the last word are always zero, so two vectors are
+      equal exactly when their words are.
+  */
+  class BitVector
+  {
+  private:
+    std::vector<uint64_t> m_words;
+    size_t m_size;
+
+    static size_t mWordCount(size_t n)
+    { return (n+63)/64; }
+
+    void mClearTail()
+    {
+      if(m_size%64)
+        m_words.back() &= (uint64_t(1)<<(m_size%64))-1;
+    }
+  public:
+    BitVector()
+      : m_size(0)
+    {}
+
+    explicit BitVector(size_t n, bool value=false)
+      : m_words(mWordCount(n), value ? ~uint64_t(0) : 0)
+      , m_size(n)
+    {
+      mClearTail();
+    }
+
+    //! Take n bits from words packed as described above; extra bits are ignored
+    BitVector(std::vector<uint64_t> words, size_t n)
+      : m_words(std::move(words))
+      , m_size(n)
+    {
+      m_words.resize(mWordCount(n), 0);
+      mClearTail();
+    }
+
+    explicit BitVector(const std::vector<bool> &bits)
+      : m_words(mWordCount(bits.size()), 0)
+      , m_size(bits.size())
+    {
+      for(size_t i=0; i<m_size; i++){
+        if(bits[i])
+          m_words[i/64] |= uint64_t(1)<<(i%64);
+      }
+    }
+
+    std::vector<bool> ToVector() const
+    {
+      std::vector<bool> res(m_size);
+      for(size_t i=0; i<m_size; i++){
+        res[i]=(*this)[i];
+      }
+      return res;
+    }
+
+    size_t size() const
+    { return m_size; }
+
+    //! New bits are set to value
+    void resize(size_t n, bool value=false)
+    {
+      size_t old=m_size;
+      m_words.resize(mWordCount(n), value ? ~uint64_t(0) : 0);
+      m_size=n;
+      if(value && old<n && old%64)
+        m_words[old/64] |= ~uint64_t(0) << (old%64);
+      mClearTail();
+    }
+
+    bool operator[](size_t i) const
+    { return (m_words[i/64]>>(i%64))&1; }
+
+    bool at(size_t i) const
+    {
+      if(i>=m_size)
+        throw std::out_of_range("BitVector::at - index out of range.");
+      return (*this)[i];
+    }
+
+    void Set(size_t i, bool value)
+    {
+      uint64_t mask=uint64_t(1)<<(i%64);
+      m_words[i/64] = value ? (m_words[i/64] | mask) : (m_words[i/64] & ~mask);
+    }
+
+    const std::vector<uint64_t> &Words() const
+    { return m_words; }
+
+    bool operator==(const BitVector &o) const
+    { return m_size==o.m_size && m_words==o.m_words; }
+
+    bool operator!=(const BitVector &o) const
+    { return !(*this==o); }
+  };
+
+}; // puzzler
+
+#endif
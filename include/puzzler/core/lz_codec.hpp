@@ -0,0 +1,154 @@
+#ifndef puzzler_core_lz_codec_hpp
+#define puzzler_core_lz_codec_hpp
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <stdexcept>
+
+namespace puzzler{
+
+  /* A small LZ77 block codec in the style of LZ4: fast, greedy, and single
+     pass, trading ratio for speed.
+
+     A block is a sequence of
+       token      : high nibble literal count, low nibble match length-4;
+                    15 in either means more length bytes follow
+       [lengths]  : extra literal count bytes, each added, until one < 255
+       literals
+       offset     : 2 bytes, little-endian, distance back to the match
+       [lengths]  : extra match length bytes, as for literals
+     The last sequence has literals only, and ends the block.
+  */
+
+  namespace detail{
+    static const unsigned LzMinMatch=4;
+    static const unsigned LzHashBits=16;
+    static const size_t LzMaxOffset=65535;
+
+    inline uint32_t LzRead32(const uint8_t *p)
+    {
+      uint32_t x;
+      memcpy(&x, p, 4);
+      return x;
+    }
+
+    inline void LzPutLength(std::vector<uint8_t> &dst, size_t len)
+    {
+      while(len>=255){
+        dst.push_back(255);
+        len-=255;
+      }
+      dst.push_back(uint8_t(len));
+    }
+  };
+
+  //! Append the compressed form of src[0,n) to dst
+  inline void LzCompress(const uint8_t *src, size_t n, std::vector<uint8_t> &dst)
+  {
+    using namespace detail;
+
+    std::vector<uint32_t> table(size_t(1)<<LzHashBits, 0);  // position+1, or 0
+
+    size_t anchor=0, i=0;
+    while(n>=LzMinMatch && i<=n-LzMinMatch){
+      uint32_t seq=LzRead32(src+i);
+      uint32_t h=(seq*2654435761u)>>(32-LzHashBits);
+      size_t cand=table[h];
+      table[h]=uint32_t(i+1);
+
+      if(cand==0 || i-(cand-1)>LzMaxOffset || LzRead32(src+cand-1)!=seq){
+        // Skip faster through data that doesn't match
+        i+=1+((i-anchor)>>6);
+        continue;
+      }
+      cand--;
+
+      size_t len=LzMinMatch;
+      while(i+len<n && src[cand+len]==src[i+len]){
+        len++;
+      }
+
+      size_t lit=i-anchor;
+      size_t match=len-LzMinMatch;
+      dst.push_back(uint8_t(((lit<15 ? lit : 15)<<4) | (match<15 ? match : 15)));
+      if(lit>=15)
+        LzPutLength(dst, lit-15);
+      dst.insert(dst.end(), src+anchor, src+i);
+      size_t offset=i-cand;
+      dst.push_back(uint8_t(offset&0xFF));
+      dst.push_back(uint8_t(offset>>8));
+      if(match>=15)
+        LzPutLength(dst, match-15);
+
+      i+=len;
+      anchor=i;
+    }
+
+    size_t lit=n-anchor;
+    dst.push_back(uint8_t((lit<15 ? lit : 15)<<4));
+    if(lit>=15)
+      LzPutLength(dst, lit-15);
+    dst.insert(dst.end(), src+anchor, src+n);
+  }
+
+  //! Decompress src[0,n), which must expand to exactly rawSize bytes at dst
+  inline void LzDecompress(const uint8_t *src, size_t n, uint8_t *dst, size_t rawSize)
+  {
+    const uint8_t *ip=src, *ipEnd=src+n;
+    uint8_t *op=dst, *opEnd=dst+rawSize;
+
+    auto corrupt=[](){
+      throw std::runtime_error("LzDecompress - corrupt data.");
+    };
+    auto getLength=[&](size_t len) -> size_t {
+      if(len==15){
+        uint8_t b;
+        do{
+          if(ip==ipEnd)
+            corrupt();
+          b=*ip++;
+          len+=b;
+        }while(b==255);
+      }
+      return len;
+    };
+
+    while(true){
+      if(ip==ipEnd)
+        corrupt();
+      uint8_t token=*ip++;
+
+      size_t lit=getLength(token>>4);
+      if(lit > size_t(ipEnd-ip) || lit > size_t(opEnd-op))
+        corrupt();
+      memcpy(op, ip, lit);
+      ip+=lit;
+      op+=lit;
+
+      if(ip==ipEnd)
+        break;  // Final literals-only sequence
+
+      if(ipEnd-ip<2)
+        corrupt();
+      size_t offset=ip[0] | (size_t(ip[1])<<8);
+      ip+=2;
+      size_t len=getLength(token&0xF)+detail::LzMinMatch;
+      if(offset==0 || offset>size_t(op-dst) || len>size_t(opEnd-op))
+        corrupt();
+
+      // Matches may overlap their own output, so copy forwards byte by byte
+      const uint8_t *from=op-offset;
+      for(size_t k=0; k<len; k++){
+        op[k]=from[k];
+      }
+      op+=len;
+    }
+
+    if(op!=opEnd)
+      corrupt();
+  }
+
+}; // puzzler
+
+#endif
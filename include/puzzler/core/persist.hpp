@@ -2,8 +2,10 @@
 #define puzzler_core_persist_hpp
 
 #include "puzzler/core/stream.hpp"
+#include "puzzler/core/bit_vector.hpp"
 
 #include <complex>
+#include <algorithm>
 
 namespace puzzler{
 
@@ -18,17 +20,215 @@ namespace puzzler{
     virtual void Persist(PersistContext &ctxt) =0;
   };
 
+  /* Types whose wire format is just their bytes as big-endian words of
+     WordSize bytes, so vectors of them can be moved in bulk. WordSize is 0
+     for everything else. */
+  template<class T>
+  struct PersistBulk
+  { static const unsigned WordSize=0; };
+
+  template<> struct PersistBulk<uint32_t> { static const unsigned WordSize=4; };
+  template<> struct PersistBulk<int32_t> { static const unsigned WordSize=4; };
+  template<> struct PersistBulk<float> { static const unsigned WordSize=4; };
+  template<> struct PersistBulk<uint64_t> { static const unsigned WordSize=8; };
+  template<> struct PersistBulk<double> { static const unsigned WordSize=8; };
+
+  //! Pairs qualify if both halves are the same word size, so there is no padding
+  template<class A, class B>
+  struct PersistBulk<std::pair<A,B> >
+  {
+    static const unsigned WordSize =
+      (PersistBulk<A>::WordSize==PersistBulk<B>::WordSize && sizeof(std::pair<A,B>)==2*PersistBulk<A>::WordSize)
+      ? PersistBulk<A>::WordSize : 0;
+  };
+
   class PersistContext
   {
   private:
     bool m_sending;
     Stream *m_pStream;
+
+    /* Words on the wire are big-endian unless a byte order mark says
+       otherwise (see SendOrRecvByteOrderMark). m_swap is set if the wire
+       order differs from the host's. After a mark, word arrays are padded to
+       a multiple of their word size from m_alignBase, the end of the mark. */
+    bool m_swap;
+    bool m_alignArrays;
+    uint64_t m_alignBase;
+
+    static bool mIsBigEndian()
+    { return htonl(1)==1; }
+
+    static void mByteSwap(uint32_t *p, size_t n)
+    {
+      for(size_t i=0; i<n; i++){
+#if defined(__GNUC__)
+        p[i]=__builtin_bswap32(p[i]);
+#else
+        uint32_t x=p[i];
+        p[i]=(x>>24) | ((x>>8)&0xFF00u) | ((x<<8)&0xFF0000u) | (x<<24);
+#endif
+      }
+    }
+
+    static void mByteSwap(uint64_t *p, size_t n)
+    {
+      for(size_t i=0; i<n; i++){
+#if defined(__GNUC__)
+        p[i]=__builtin_bswap64(p[i]);
+#else
+        uint64_t x=p[i];
+        x=((x&0x00000000FFFFFFFFull)<<32) | (x>>32);
+        x=((x&0x0000FFFF0000FFFFull)<<16) | ((x>>16)&0x0000FFFF0000FFFFull);
+        p[i]=((x&0x00FF00FF00FF00FFull)<<8) | ((x>>8)&0x00FF00FF00FF00FFull);
+#endif
+      }
+    }
+
+    template<class TWord>
+    void mSendOrRecvWord(TWord &x)
+    {
+      TWord raw=x;
+      if(m_sending){
+        if(m_swap)
+          mByteSwap(&raw, 1);
+        m_pStream->Send(sizeof(TWord), &raw);
+      }else{
+        m_pStream->Recv(sizeof(TWord), &raw);
+        if(m_swap)
+          mByteSwap(&raw, 1);
+        x=raw;
+      }
+    }
+
+    //! Zero padding up to the next multiple of alignment, when arrays are aligned
+    void mAlign(unsigned alignment)
+    {
+      if(!m_alignArrays)
+        return;
+      uint64_t offset = (m_sending ? m_pStream->SendOffset() : m_pStream->RecvOffset()) - m_alignBase;
+      uint8_t padding[8]={0,0,0,0,0,0,0,0};
+      size_t todo=size_t(-offset) & (alignment-1);
+      if(todo==0)
+        return;
+      if(m_sending){
+        m_pStream->Send(todo, padding);
+      }else{
+        m_pStream->Recv(todo, padding);
+      }
+    }
+
+    /* Swap n words of type TWord stored at p, which may hold floats, pairs
+       and so on. Each word goes through memcpy rather than a TWord pointer,
+       so this doesn't break strict aliasing, and still vectorises. */
+    template<class TWord>
+    static void mByteSwapWords(void *p, size_t n)
+    {
+      uint8_t *bytes=(uint8_t*)p;
+      for(size_t i=0; i<n; i++){
+        TWord x;
+        memcpy(&x, bytes+i*sizeof(TWord), sizeof(TWord));
+        mByteSwap(&x, 1);
+        memcpy(bytes+i*sizeof(TWord), &x, sizeof(TWord));
+      }
+    }
+
+    /* Move n words of type TWord in wire order, from or to p, which holds
+       elements of any PersistBulk type. Receiving reads straight into the
+       destination with one Recv, then swaps in place if needed. Sending can't
+       touch the source, so when swapping it goes through a fixed size buffer,
+       with one Send per ChunkBytes. */
+    template<class TWord>
+    void mSendOrRecvWords(void *p, size_t n)
+    {
+      if(n==0)
+        return;
+      mAlign(sizeof(TWord));
+
+      if(!m_sending){
+        m_pStream->Recv(n*sizeof(TWord), p);
+        if(m_swap)
+          mByteSwapWords<TWord>(p, n);
+      }else if(!m_swap){
+        m_pStream->Send(n*sizeof(TWord), p);
+      }else{
+        const size_t ChunkBytes=1<<16;
+        const size_t chunk=ChunkBytes/sizeof(TWord);
+        const uint8_t *src=(const uint8_t*)p;
+        std::vector<TWord> tmp(std::min(n, chunk));
+        for(size_t i=0; i<n; i+=chunk){
+          size_t todo=std::min(n-i, chunk);
+          memcpy(&tmp[0], src+i*sizeof(TWord), todo*sizeof(TWord));
+          mByteSwap(&tmp[0], todo);
+          m_pStream->Send(todo*sizeof(TWord), &tmp[0]);
+        }
+      }
+    }
   public:
     PersistContext(Stream *pStream, bool isSending)
       : m_sending(isSending)
       , m_pStream(pStream)
+      , m_swap(!mIsBigEndian())
+      , m_alignArrays(false)
+      , m_alignBase(0)
     {}
 
+    /*! Switch from the default big-endian encoding to the host's own order,
+        with aligned arrays, for everything after this point. When sending,
+        writes a marker in host order; when receiving, reads the marker and
+        uses whichever order the sender used.
+
+        The marker is a padding count byte, that many zero bytes, then
+        0x01020304 as a word. The padding makes the marker end on a multiple
+        of 8 from the start of the stream, so arrays aligned relative to the
+        marker are also aligned in a mapping of the whole file.
+    */
+    PersistContext &SendOrRecvByteOrderMark()
+    {
+      const uint32_t Mark=0x01020304u;
+      uint8_t padding[8]={0,0,0,0,0,0,0,0};
+      uint32_t raw=Mark;
+      if(m_sending){
+        padding[0]=uint8_t((8-(m_pStream->SendOffset()+1+4)%8)%8);
+        m_pStream->Send(1+padding[0], padding);
+        m_pStream->Send(4, &raw);
+        m_swap=false;
+        m_alignBase=m_pStream->SendOffset();
+      }else{
+        m_pStream->Recv(1, padding);
+        if(padding[0]>=8)
+          throw std::runtime_error("PersistContext::SendOrRecvByteOrderMark - Invalid padding.");
+        if(padding[0])
+          m_pStream->Recv(padding[0], padding+1);
+        m_pStream->Recv(4, &raw);
+        if(raw==Mark){
+          m_swap=false;
+        }else{
+          mByteSwap(&raw, 1);
+          if(raw!=Mark)
+            throw std::runtime_error("PersistContext::SendOrRecvByteOrderMark - Invalid byte order mark.");
+          m_swap=true;
+        }
+        m_alignBase=m_pStream->RecvOffset();
+      }
+      m_alignArrays=true;
+      return *this;
+    }
+
+    bool IsSending() const
+    { return m_sending; }
+
+    //! True if received words are being byte swapped
+    bool IsSwapping() const
+    { return m_swap; }
+
+    //! Reverse the bytes of each of n words in place
+    static void ByteSwap(uint32_t *p, size_t n)
+    { mByteSwap(p, n); }
+
+    static void ByteSwap(uint64_t *p, size_t n)
+    { mByteSwap(p, n); }
+
     template<class T>
     PersistContext &SendOrRecv(T &x)
     {
@@ -38,22 +238,14 @@ namespace puzzler{
 
     PersistContext &SendOrRecv(uint32_t &x)
     {
-      uint32_t raw=htonl(x);
-      if(m_sending){
-        m_pStream->Send(4, &raw);
-      }else{
-        m_pStream->Recv(4, &raw);
-      }
-      x=ntohl(raw);
+      mSendOrRecvWord(x);
       return *this;
     }
 
     PersistContext &SendOrRecv(uint64_t &x)
     {
-      uint32_t hi=(x>>32), lo=uint32_t(x&0xFFFFFFFFUL);
-      SendOrRecv(hi);
-      SendOrRecv(lo);
-      x=(uint64_t(hi)<<32) | lo;
+      // In big-endian order this is the high word then the low word
+      mSendOrRecvWord(x);
       return *this;
     }
 
@@ -155,6 +347,49 @@ namespace puzzler{
       return *this;
     }
 
+    /*! Same wire format as std::vector<bool>: bit i is bit i%8 of byte i/8,
+        which is how the words are laid out in memory on a little-endian
+        host. So the bytes go in one transfer, and only a big-endian host
+        has to swap the words. */
+    PersistContext &SendOrRecv(BitVector &x)
+    {
+      uint32_t n=x.size();
+      SendOrRecv(n);
+      size_t bytes=(size_t(n)+7)/8;
+
+      if(m_sending){
+        if(!mIsBigEndian()){
+          if(bytes)
+            m_pStream->Send(bytes, &x.Words()[0]);
+        }else{
+          std::vector<uint64_t> tmp(x.Words());
+          if(!tmp.empty())
+            mByteSwap(&tmp[0], tmp.size());
+          if(bytes)
+            m_pStream->Send(bytes, &tmp[0]);
+        }
+      }else{
+        std::vector<uint64_t> words((size_t(n)+63)/64, 0);
+        if(bytes)
+          m_pStream->Recv(bytes, &words[0]);
+        if(mIsBigEndian() && !words.empty())
+          mByteSwap(&words[0], words.size());
+        x=BitVector(std::move(words), n);
+      }
+      return *this;
+    }
+
+    /*! Raw bytes, with no length or conversion. Lets a std::vector<uint8_t>
+        be sent in pieces: send its length as a uint32, then the elements. */
+    PersistContext &SendBytes(const void *pData, size_t cbData)
+    {
+      if(!m_sending)
+        throw std::runtime_error("PersistContext::SendBytes - can only send bytes.");
+      if(cbData)
+        m_pStream->Send(cbData, pData);
+      return *this;
+    }
+
     PersistContext &SendOrRecv(std::vector<uint8_t> &x)
     {
       uint32_t n=x.size();
@@ -174,11 +409,53 @@ namespace puzzler{
       uint32_t n=x.size();
       SendOrRecv(n);
       x.resize(n);
-      for(uint32_t i=0; i<n; i++){
-	SendOrRecv(x[i]);
+      if(n==0)
+        return *this;
+      return SendOrRecvArray(&x[0], n);
+    }
+
+    //! The elements of a vector, without the length in front
+    template<class T>
+    PersistContext &SendOrRecvArray(T *p, size_t n)
+    {
+      // Same wire format as the element loop, but in a few large transfers
+      const unsigned wordSize=PersistBulk<T>::WordSize;
+      if(wordSize==4){
+        mSendOrRecvWords<uint32_t>(p, n*sizeof(T)/4);
+      }else if(wordSize==8){
+        mSendOrRecvWords<uint64_t>(p, n*sizeof(T)/8);
+      }else{
+        for(size_t i=0; i<n; i++){
+          SendOrRecv(p[i]);
+        }
       }
       return *this;
     }
+
+    /*! Receive n words sent with SendOrRecvArray, exactly as they are on the
+        wire, so the caller can swap them (see IsSwapping and ByteSwap) as it
+        goes. Points into the stream if it supports views, else into storage.
+        This lets large arrays be decoded in parallel. */
+    template<class TWord>
+    const TWord *RecvWords(size_t n, std::vector<TWord> &storage)
+    {
+      if(m_sending)
+        throw std::runtime_error("PersistContext::RecvWords - can only receive.");
+      storage.clear();
+      if(n==0)
+        return 0;
+      mAlign(sizeof(TWord));
+      const TWord *view=(const TWord*)m_pStream->RecvView(n*sizeof(TWord));
+      if(view && size_t(view) % alignof(TWord) == 0)
+        return view;
+      storage.resize(n);
+      if(view){
+        memcpy(&storage[0], view, n*sizeof(TWord));
+      }else{
+        m_pStream->Recv(n*sizeof(TWord), &storage[0]);
+      }
+      return &storage[0];
+    }
     
     template<class T>
     PersistContext &SendOrRecv(std::complex<T> &x)
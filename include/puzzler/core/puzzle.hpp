@@ -13,6 +13,16 @@ namespace puzzler
   {
   public:
 
+    /* Inputs and outputs come in two formats, which differ only in how the
+       fields after the puzzle name are encoded:
+       - v0 is big-endian throughout;
+       - v1 is followed by a byte order mark, then everything is in the
+         writer's native order, with word arrays aligned to their word size
+         so that a reader on a matching host can use them in place.
+       Both load anywhere. */
+    static bool IsNativeFormat(const std::string &format)
+    { return format=="puzzle.input.v1" || format=="puzzle.output.v1"; }
+
     class Input
       : public virtual Persistable
     {
@@ -31,8 +41,10 @@ namespace puzzler
 	: m_format(format)
 	, m_puzzleName(puzzleName)
       {
-	if(format!="puzzle.input.v0")
+	if(format!="puzzle.input.v0" && format!="puzzle.input.v1")
 	  throw std::runtime_error("Puzzle::Input - Invalid format string.");
+	if(IsNativeFormat(format))
+	  ctxt.SendOrRecvByteOrderMark();
 	ctxt.SendOrRecv(m_scale);
       }
 
@@ -40,8 +52,12 @@ namespace puzzler
     public:
       virtual void Persist(PersistContext &ctxt) override final
       {
-	ctxt.SendOrRecv(m_format,"puzzle.input.v0");
+	ctxt.SendOrRecv(m_format);
+	if(m_format!="puzzle.input.v0" && m_format!="puzzle.input.v1")
+	  throw std::runtime_error("Puzzle::Input::Persist - Invalid format string.");
 	ctxt.SendOrRecv(m_puzzleName);
+	if(IsNativeFormat(m_format))
+	  ctxt.SendOrRecvByteOrderMark();
 	ctxt.SendOrRecv(m_scale);
 	PersistImpl(ctxt);
       }
@@ -50,6 +66,13 @@ namespace puzzler
     public:
       std::string PuzzleName() const
       { return m_puzzleName; }
+
+      std::string Format() const
+      { return m_format; }
+
+      //! Choose the format used by Persist, either v0 or v1 (see above)
+      void SetNativeFormat(bool native)
+      { m_format = native ? "puzzle.input.v1" : "puzzle.input.v0"; }
     };
 
     class Output
@@ -59,29 +82,43 @@ namespace puzzler
       std::string m_format;
       std::string m_puzzleName;
     protected:
-      Output(const Puzzle *puzzle, const Input *)
-	: m_format("puzzle.output.v0")
+      //! Outputs are written in the same format as their input
+      Output(const Puzzle *puzzle, const Input *input)
+	: m_format(input && IsNativeFormat(input->Format()) ? "puzzle.output.v1" : "puzzle.output.v0")
 	, m_puzzleName(puzzle->Name())
       {
       }
 
-      Output(std::string format, std::string puzzleName, PersistContext &)
+      Output(std::string format, std::string puzzleName, PersistContext &ctxt)
 	: m_format(format)
 	, m_puzzleName(puzzleName)
       {
-	if(format!="puzzle.output.v0")
+	if(format!="puzzle.output.v0" && format!="puzzle.output.v1")
 	  throw std::runtime_error("Puzzle::Output - Invalid format string.");
+	if(IsNativeFormat(format))
+	  ctxt.SendOrRecvByteOrderMark();
       }
 
       virtual void PersistImpl(PersistContext &ctxt) =0;
     public:
       virtual void Persist(PersistContext &ctxt) override final
       {
-	ctxt.SendOrRecv(m_format, "puzzle.output.v0");
-	ctxt.SendOrRecv(m_puzzleName);
+	PersistHeader(ctxt);
 	PersistImpl(ctxt);
       }
 
+      /*! Just the part of Persist before the puzzle's own fields. Outputs
+          that are written incrementally send this, then their fields. */
+      void PersistHeader(PersistContext &ctxt)
+      {
+	ctxt.SendOrRecv(m_format);
+	if(m_format!="puzzle.output.v0" && m_format!="puzzle.output.v1")
+	  throw std::runtime_error("Puzzle::Output::Persist - Invalid format string.");
+	ctxt.SendOrRecv(m_puzzleName);
+	if(IsNativeFormat(m_format))
+	  ctxt.SendOrRecvByteOrderMark();
+      }
+
       virtual bool Equals(const Output *output) const=0;
 
       std::string PuzzleName() const
@@ -106,6 +143,13 @@ namespace puzzler
     //! Load a previously created output
     virtual std::shared_ptr<Output> LoadOutput(PersistContext &ctxt) const=0;
 
+    /*! True if Output::Equals is plain equality of everything persisted, so
+        outputs with identical bytes are always equal and tools can compare
+        them by hash. Leave it false when comparing with a tolerance, as a
+        NaN isn't even equal to itself. */
+    virtual bool OutputsAreExact() const
+    { return false; }
+
     virtual std::shared_ptr<Output> LoadOutput(std::string format, std::string name, PersistContext &ctxt) const=0;
 
     //! "True" version of the solution. It may be slow, but will be correct
@@ -114,6 +158,17 @@ namespace puzzler
     //! "Fast" version of the solution, provided by the user
     virtual void Execute(ILog *log, const Input *pInput, Output *pOutput) const=0;
 
+    /*! Execute, and write the output to ctxt (which must be sending) in the
+        same form as Output::Persist. By default the whole output is built
+        first. Puzzles can override this to send parts of the output as they
+        are finished, so it never has to be held in memory all at once. */
+    virtual void ExecuteToStream(ILog *log, const Input *pInput, PersistContext &ctxt) const
+    {
+      auto output=MakeEmptyOutput(pInput);
+      Execute(log, pInput, output.get());
+      output->Persist(ctxt);
+    }
+
   };
 
   class PuzzleRegistrar
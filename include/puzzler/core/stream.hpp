@@ -46,6 +46,25 @@ namespace puzzler{
     virtual void Send(size_t cbData, const void *pData) =0;
     virtual void Recv(size_t cbData, void *pData) =0;
 
+    /*! Receive between 1 and cbMax bytes, or 0 at end of stream, returning
+        how many arrived. Lets buffering layers read ahead without knowing
+        where the data ends. The default can only do an exact Recv. */
+    virtual size_t RecvSome(size_t cbMax, void *pData)
+    {
+      Recv(cbMax, pData);
+      return cbMax;
+    }
+
+    /*! Receive cbData bytes without copying them, for streams which already
+        hold the data in memory. Returns a pointer which stays valid for the
+        life of the stream, or null, having consumed nothing, if this stream
+        can't do that. */
+    virtual const void *RecvView(size_t cbData)
+    {
+      (void)cbData;
+      return 0;
+    }
+
     //! Return the current offset from some arbitrary starting point
     virtual uint64_t SendOffset() const =0;
     virtual uint64_t RecvOffset() const =0;
@@ -0,0 +1,94 @@
+#ifndef  puzzler_core_streams_buffered_in_hpp
+#define  puzzler_core_streams_buffered_in_hpp
+
+#include "puzzler/core/stream.hpp"
+
+#include <algorithm>
+
+namespace puzzler{
+
+  /*! Reads ahead from another stream in large blocks, so that the many small
+      Recv calls made while persisting (a 4 byte Recv per field) come from
+      memory rather than a system call each. Requests at least as big as the
+      buffer go straight to the inner stream.
+
+      The inner stream must outlive this one, and this stream may read up to
+      bufferSize bytes past the last byte it hands out.
+  */
+  class BufferedInStream
+    : public Stream
+  {
+  private:
+    // No implementation for either
+    BufferedInStream(const BufferedInStream &); // = delete;
+    BufferedInStream &operator=(const BufferedInStream &); // = delete;
+
+    Stream *m_pInner;
+    std::vector<uint8_t> m_buffer;
+    size_t m_begin, m_end;  // Unread bytes are m_buffer[m_begin,m_end)
+    uint64_t m_offset;
+  public:
+    static const size_t DefaultBufferSize=1<<20;
+
+    BufferedInStream(Stream *pInner, size_t bufferSize=DefaultBufferSize)
+      : m_pInner(pInner)
+      , m_buffer(std::max<size_t>(bufferSize, 1))
+      , m_begin(0)
+      , m_end(0)
+      , m_offset(pInner->RecvOffset())
+    {}
+
+    virtual void Send(size_t , const void *)
+    {
+      throw std::runtime_error("BufferedInStream::Send - no such operation.");
+    }
+
+    virtual void Recv(size_t cbData, void *pData)
+    {
+      uint8_t *dst=(uint8_t*)pData;
+      while(cbData>0){
+        if(m_begin==m_end){
+          if(cbData>=m_buffer.size()){
+            m_pInner->Recv(cbData, dst);
+            m_offset+=cbData;
+            return;
+          }
+          m_begin=0;
+          m_end=m_pInner->RecvSome(m_buffer.size(), &m_buffer[0]);
+          if(m_end==0)
+            throw std::runtime_error("BufferedInStream::Recv - End of file.");
+        }
+        size_t todo=std::min(cbData, m_end-m_begin);
+        memcpy(dst, &m_buffer[m_begin], todo);
+        m_begin+=todo;
+        m_offset+=todo;
+        dst+=todo;
+        cbData-=todo;
+      }
+    }
+
+    virtual size_t RecvSome(size_t cbMax, void *pData)
+    {
+      if(m_begin==m_end){
+        m_begin=0;
+        m_end=m_pInner->RecvSome(m_buffer.size(), &m_buffer[0]);
+      }
+      size_t todo=std::min(cbMax, m_end-m_begin);
+      memcpy(pData, &m_buffer[m_begin], todo);
+      m_begin+=todo;
+      m_offset+=todo;
+      return todo;
+    }
+
+    //! Return the current offset from some arbitrary starting point
+    virtual uint64_t SendOffset() const
+    { return 0; }
+
+    //! Offset of the next byte to be handed out, not of what has been read ahead
+    virtual uint64_t RecvOffset() const
+    { return m_offset; }
+  };
+
+}; // puzzler
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef  puzzler_core_streams_buffered_out_hpp
+#define  puzzler_core_streams_buffered_out_hpp
+
+#include "puzzler/core/stream.hpp"
+
+#include <algorithm>
+
+namespace puzzler{
+
+  /*! Collects the many small Send calls made while persisting into large
+      blocks before passing them to another stream. Sends at least as big as
+      the buffer go straight through, after anything already buffered.
+
+      Call Flush once everything is sent, so that errors are reported; the
+      destructor also flushes, but has to ignore failures. The inner stream
+      must outlive this one.
+  */
+  class BufferedOutStream
+    : public Stream
+  {
+  private:
+    // No implementation for either
+    BufferedOutStream(const BufferedOutStream &); // = delete;
+    BufferedOutStream &operator=(const BufferedOutStream &); // = delete;
+
+    Stream *m_pInner;
+    std::vector<uint8_t> m_buffer;
+    size_t m_used;
+    uint64_t m_offset;
+  public:
+    static const size_t DefaultBufferSize=1<<20;
+
+    BufferedOutStream(Stream *pInner, size_t bufferSize=DefaultBufferSize)
+      : m_pInner(pInner)
+      , m_buffer(std::max<size_t>(bufferSize, 1))
+      , m_used(0)
+      , m_offset(pInner->SendOffset())
+    {}
+
+    ~BufferedOutStream()
+    {
+      try{
+        Flush();
+      }catch(...){
+        // Nowhere to report it from a destructor
+      }
+    }
+
+    //! Pass everything buffered on to the inner stream
+    void Flush()
+    {
+      if(m_used>0){
+        size_t todo=m_used;
+        m_used=0;
+        m_pInner->Send(todo, &m_buffer[0]);
+      }
+    }
+
+    virtual void Send(size_t cbData, const void *pData)
+    {
+      if(cbData==0)
+        return;
+      const uint8_t *src=(const uint8_t*)pData;
+      m_offset+=cbData;
+      if(m_used+cbData > m_buffer.size()){
+        Flush();
+        if(cbData>=m_buffer.size()){
+          m_pInner->Send(cbData, src);
+          return;
+        }
+      }
+      memcpy(&m_buffer[m_used], src, cbData);
+      m_used+=cbData;
+    }
+
+    virtual void Recv(size_t , void *)
+    {
+      throw std::runtime_error("BufferedOutStream::Recv - no such operation.");
+    }
+
+    //! Offset including bytes still held in the buffer
+    virtual uint64_t SendOffset() const
+    { return m_offset; }
+
+    virtual uint64_t RecvOffset() const
+    { return 0; }
+  };
+
+}; // puzzler
+
+#endif
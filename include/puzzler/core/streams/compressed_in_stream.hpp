@@ -0,0 +1,160 @@
+#ifndef  puzzler_core_streams_compressed_in_hpp
+#define  puzzler_core_streams_compressed_in_hpp
+
+#include "puzzler/core/streams/compressed_out_stream.hpp"
+
+namespace puzzler{
+
+  /*! Reads a stream written by CompressedOutStream, or, if the stream doesn't
+      start with the magic bytes, passes it through unchanged. So readers can
+      wrap any input in one of these and accept both.
+
+      Views are passed through from the inner stream for uncompressed input,
+      but not offered for compressed input, where the data only lives in a
+      chunk buffer. The inner stream must outlive this one.
+  */
+  class CompressedInStream
+    : public Stream
+  {
+  private:
+    // No implementation for either
+    CompressedInStream(const CompressedInStream &); // = delete;
+    CompressedInStream &operator=(const CompressedInStream &); // = delete;
+
+    Stream *m_pInner;
+    bool m_compressed;
+    bool m_ended;
+
+    // Decoded bytes not yet handed out are m_raw[m_begin,m_end). When passing
+    // through, this holds whatever was read while looking for the magic.
+    std::vector<uint8_t> m_raw;
+    size_t m_begin, m_end;
+    std::vector<uint8_t> m_packed;
+    uint64_t m_offset;
+
+    // Returns false at the end of the stream
+    bool mNextChunk()
+    {
+      if(m_ended)
+        return false;
+
+      uint32_t header[2];
+      m_pInner->Recv(8, header);
+      uint32_t rawSize=ntohl(header[0]), packedSize=ntohl(header[1]);
+      if(rawSize==0){
+        m_ended=true;
+        return false;
+      }
+
+      bool stored=(packedSize & CompressedStreamStoredFlag)!=0;
+      packedSize&=~CompressedStreamStoredFlag;
+      if(stored ? packedSize!=rawSize : packedSize>=rawSize)
+        throw std::runtime_error("CompressedInStream - corrupt chunk header.");
+
+      m_raw.resize(rawSize);
+      if(stored){
+        m_pInner->Recv(rawSize, &m_raw[0]);
+      }else{
+        m_packed.resize(packedSize);
+        m_pInner->Recv(packedSize, &m_packed[0]);
+        LzDecompress(&m_packed[0], packedSize, &m_raw[0], rawSize);
+      }
+      m_begin=0;
+      m_end=rawSize;
+      return true;
+    }
+  public:
+    CompressedInStream(Stream *pInner)
+      : m_pInner(pInner)
+      , m_compressed(false)
+      , m_ended(false)
+      , m_raw(4)
+      , m_begin(0)
+      , m_end(0)
+      , m_offset(pInner->RecvOffset())
+    {
+      // Short inputs can't be compressed streams, but may still be valid
+      while(m_end<4){
+        size_t got=m_pInner->RecvSome(4-m_end, &m_raw[m_end]);
+        if(got==0)
+          break;
+        m_end+=got;
+      }
+      if(m_end==4 && 0==memcmp(&m_raw[0], CompressedStreamMagic, 4)){
+        m_compressed=true;
+        m_begin=m_end=0;
+        m_offset=0;
+      }
+    }
+
+    //! True if the inner stream turned out to be compressed
+    bool IsCompressed() const
+    { return m_compressed; }
+
+    virtual void Send(size_t , const void *)
+    {
+      throw std::runtime_error("CompressedInStream::Send - no such operation.");
+    }
+
+    virtual void Recv(size_t cbData, void *pData)
+    {
+      uint8_t *dst=(uint8_t*)pData;
+      while(cbData>0){
+        if(m_begin==m_end){
+          if(!m_compressed){
+            m_pInner->Recv(cbData, dst);
+            m_offset+=cbData;
+            return;
+          }
+          if(!mNextChunk())
+            throw std::runtime_error("CompressedInStream::Recv - End of file.");
+        }
+        size_t todo=std::min(cbData, m_end-m_begin);
+        memcpy(dst, &m_raw[m_begin], todo);
+        m_begin+=todo;
+        m_offset+=todo;
+        dst+=todo;
+        cbData-=todo;
+      }
+    }
+
+    virtual size_t RecvSome(size_t cbMax, void *pData)
+    {
+      if(m_begin==m_end){
+        if(!m_compressed){
+          size_t got=m_pInner->RecvSome(cbMax, pData);
+          m_offset+=got;
+          return got;
+        }
+        if(!mNextChunk())
+          return 0;
+      }
+      size_t todo=std::min(cbMax, m_end-m_begin);
+      memcpy(pData, &m_raw[m_begin], todo);
+      m_begin+=todo;
+      m_offset+=todo;
+      return todo;
+    }
+
+    virtual const void *RecvView(size_t cbData)
+    {
+      if(m_compressed || m_begin!=m_end)
+        return 0;
+      const void *res=m_pInner->RecvView(cbData);
+      if(res)
+        m_offset+=cbData;
+      return res;
+    }
+
+    //! Return the current offset from some arbitrary starting point
+    virtual uint64_t SendOffset() const
+    { return 0; }
+
+    //! Offset in the uncompressed data
+    virtual uint64_t RecvOffset() const
+    { return m_offset; }
+  };
+
+}; // puzzler
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef  puzzler_core_streams_compressed_out_hpp
+#define  puzzler_core_streams_compressed_out_hpp
+
+#include "puzzler/core/stream.hpp"
+#include "puzzler/core/lz_codec.hpp"
+
+#include <algorithm>
+
+namespace puzzler{
+
+  /* Framing shared with CompressedInStream. A compressed stream is the magic
+     bytes, then chunks of
+       rawSize    : uint32, big-endian; 0 marks the end of the stream
+       packedSize : uint32, big-endian; top bit set if the chunk is stored
+                    uncompressed because it didn't shrink
+       data       : packedSize bytes (less the top bit)
+     Each chunk is compressed independently, so the stream can be written and
+     read incrementally. Uncompressed puzzle files start with the length of
+     the format string, which can't match the magic. */
+  static const uint8_t CompressedStreamMagic[4]={'P','Z','L','4'};
+  static const uint32_t CompressedStreamStoredFlag=0x80000000u;
+
+  /*! Compresses everything sent, in chunks of chunkSize bytes.
+
+      Flush passes on a partial chunk immediately, e.g. after each frame of an
+      animation. Finish writes the end marker; the destructor calls it, but
+      has to ignore failures, so call it explicitly. The inner stream must
+      outlive this one.
+  */
+  class CompressedOutStream
+    : public Stream
+  {
+  private:
+    // No implementation for either
+    CompressedOutStream(const CompressedOutStream &); // = delete;
+    CompressedOutStream &operator=(const CompressedOutStream &); // = delete;
+
+    Stream *m_pInner;
+    std::vector<uint8_t> m_raw;
+    size_t m_used;
+    std::vector<uint8_t> m_packed;
+    uint64_t m_offset;
+    bool m_finished;
+
+    void mSendHeader(uint32_t rawSize, uint32_t packedSize)
+    {
+      uint32_t header[2]={htonl(rawSize), htonl(packedSize)};
+      m_pInner->Send(8, header);
+    }
+  public:
+    static const size_t DefaultChunkSize=1<<20;
+
+    CompressedOutStream(Stream *pInner, size_t chunkSize=DefaultChunkSize)
+      : m_pInner(pInner)
+      , m_raw(std::max<size_t>(1, std::min<size_t>(chunkSize, CompressedStreamStoredFlag-1)))
+      , m_used(0)
+      , m_offset(0)
+      , m_finished(false)
+    {
+      m_pInner->Send(4, CompressedStreamMagic);
+    }
+
+    ~CompressedOutStream()
+    {
+      try{
+        Finish();
+      }catch(...){
+        // Nowhere to report it from a destructor
+      }
+    }
+
+    //! Compress and pass on whatever is buffered, as a (possibly short) chunk
+    void Flush()
+    {
+      if(m_used==0)
+        return;
+      size_t todo=m_used;
+      m_used=0;
+
+      m_packed.clear();
+      LzCompress(&m_raw[0], todo, m_packed);
+      if(m_packed.size()<todo){
+        mSendHeader(todo, m_packed.size());
+        m_pInner->Send(m_packed.size(), &m_packed[0]);
+      }else{
+        mSendHeader(todo, todo|CompressedStreamStoredFlag);
+        m_pInner->Send(todo, &m_raw[0]);
+      }
+    }
+
+    //! Flush, then mark the end of the stream. Nothing can be sent after this.
+    void Finish()
+    {
+      if(m_finished)
+        return;
+      Flush();
+      mSendHeader(0, 0);
+      m_finished=true;
+    }
+
+    virtual void Send(size_t cbData, const void *pData)
+    {
+      if(m_finished)
+        throw std::runtime_error("CompressedOutStream::Send - stream is finished.");
+      const uint8_t *src=(const uint8_t*)pData;
+      m_offset+=cbData;
+      while(cbData>0){
+        size_t todo=std::min(cbData, m_raw.size()-m_used);
+        memcpy(&m_raw[m_used], src, todo);
+        m_used+=todo;
+        src+=todo;
+        cbData-=todo;
+        if(m_used==m_raw.size())
+          Flush();
+      }
+    }
+
+    virtual void Recv(size_t , void *)
+    {
+      throw std::runtime_error("CompressedOutStream::Recv - no such operation.");
+    }
+
+    //! Offset in the uncompressed data
+    virtual uint64_t SendOffset() const
+    { return m_offset; }
+
+    virtual uint64_t RecvOffset() const
+    { return 0; }
+  };
+
+}; // puzzler
+
+#endif
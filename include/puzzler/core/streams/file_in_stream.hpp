@@ -41,10 +41,26 @@ namespace puzzler{
 
     virtual void Recv(size_t cbData, void *pData)
     {
-      int got=read(m_fd, pData, cbData);
-      if(got!=(int)cbData)
-        throw std::runtime_error("FileInStream::Recv - Not all data was recieved.");
+      // read may return less than asked for, e.g. on pipes or large requests
+      while(cbData>0){
+        int got=read(m_fd, pData, cbData);
+        if(got==0)
+          throw std::runtime_error("FileInStream::Recv - End of file.");
+        if(got<0)
+          throw std::runtime_error("FileInStream::Recv - Error while reading.");
+        m_offset+=got;
+        cbData-=got;
+        pData=got+(uint8_t*)pData;
+      }
+    }
+
+    virtual size_t RecvSome(size_t cbMax, void *pData)
+    {
+      int got=read(m_fd, pData, cbMax);
+      if(got<0)
+        throw std::runtime_error("FileInStream::RecvSome - Error while reading.");
       m_offset+=got;
+      return got;
     }
 
     //! Return the current offset from some arbitrary starting point
@@ -0,0 +1,147 @@
+#ifndef  puzzler_core_streams_hashing_out_hpp
+#define  puzzler_core_streams_hashing_out_hpp
+
+#include "puzzler/core/stream.hpp"
+#include "puzzler/core/xxhash64.hpp"
+
+namespace puzzler{
+
+  /* A hash trailer goes after everything else in a file, and is
+       magic      : 'P','Z','H','X'
+       size       : uint64, big-endian, number of bytes before the trailer
+       hash       : uint64, big-endian, XXH64 (seed 0) of those bytes
+     Sizes and hashes are of the uncompressed bytes, so compressing a file
+     doesn't change its trailer. Readers that don't look for it ignore it. */
+  static const uint8_t HashTrailerMagic[4]={'P','Z','H','X'};
+  static const size_t HashTrailerSize=20;
+
+  namespace detail{
+    inline uint64_t HashTrailerRead64(const uint8_t *p)
+    {
+      uint64_t x=0;
+      for(unsigned i=0; i<8; i++){
+        x=(x<<8) | p[i];
+      }
+      return x;
+    }
+  };
+
+  /*! Given the last HashTrailerSize bytes of something totalSize bytes long,
+      returns true and sets hash if they are a trailer covering the rest. */
+  inline bool ParseHashTrailer(const uint8_t *tail, uint64_t totalSize, uint64_t &hash)
+  {
+    if(totalSize<HashTrailerSize || memcmp(tail, HashTrailerMagic, 4))
+      return false;
+    if(detail::HashTrailerRead64(tail+4)!=totalSize-HashTrailerSize)
+      return false;
+    hash=detail::HashTrailerRead64(tail+12);
+    return true;
+  }
+
+  /*! Given a whole file in memory, returns false if it doesn't end with a
+      trailer. Otherwise sets hash, after checking it against the bytes the
+      trailer covers, and throws if they don't match. */
+  inline bool CheckHashTrailer(const uint8_t *data, uint64_t size, uint64_t &hash)
+  {
+    if(size<HashTrailerSize || !ParseHashTrailer(data+size-HashTrailerSize, size, hash))
+      return false;
+    XxHash64 actual;
+    actual.Update(data, size-HashTrailerSize);
+    if(actual.Digest()!=hash)
+      throw std::runtime_error("CheckHashTrailer - data doesn't match its hash trailer.");
+    return true;
+  }
+
+  /*! The same as CheckHashTrailer, but reads src to the end, hashing as it
+      goes. src must be at the start of the file. If verify is false the
+      trailer is returned as it is, without hashing what it covers. */
+  inline bool RecvHashTrailer(Stream *src, uint64_t &hash, bool verify=true)
+  {
+    if(src->RecvOffset()!=0)
+      throw std::runtime_error("RecvHashTrailer - stream must be at the start.");
+
+    // Keep the last HashTrailerSize bytes seen at the front of the buffer,
+    // and hash the ones before them
+    XxHash64 actual;
+    std::vector<uint8_t> buffer(1<<16);
+    size_t kept=0;
+    while(true){
+      size_t got=src->RecvSome(buffer.size()-kept, &buffer[kept]);
+      if(got==0)
+        break;
+      kept+=got;
+      if(kept>HashTrailerSize){
+        if(verify)
+          actual.Update(&buffer[0], kept-HashTrailerSize);
+        memmove(&buffer[0], &buffer[kept-HashTrailerSize], HashTrailerSize);
+        kept=HashTrailerSize;
+      }
+    }
+    if(kept!=HashTrailerSize || !ParseHashTrailer(&buffer[0], src->RecvOffset(), hash))
+      return false;
+    if(verify && actual.Digest()!=hash)
+      throw std::runtime_error("RecvHashTrailer - data doesn't match its hash trailer.");
+    return true;
+  }
+
+  /*! Hashes everything sent on the way through to the inner stream.
+      SendTrailer then appends the trailer described above. The inner stream
+      must outlive this one.
+  */
+  class HashingOutStream
+    : public Stream
+  {
+  private:
+    // No implementation for either
+    HashingOutStream(const HashingOutStream &); // = delete;
+    HashingOutStream &operator=(const HashingOutStream &); // = delete;
+
+    Stream *m_pInner;
+    XxHash64 m_hash;
+    uint64_t m_offset;
+  public:
+    HashingOutStream(Stream *pInner)
+      : m_pInner(pInner)
+      , m_offset(0)
+    {}
+
+    //! Hash of everything sent so far
+    uint64_t Digest() const
+    { return m_hash.Digest(); }
+
+    void SendTrailer()
+    {
+      uint8_t trailer[HashTrailerSize];
+      memcpy(trailer, HashTrailerMagic, 4);
+      uint64_t size=m_offset, hash=m_hash.Digest();
+      for(int i=7; i>=0; i--){
+        trailer[4+i]=uint8_t(size);
+        trailer[12+i]=uint8_t(hash);
+        size>>=8;
+        hash>>=8;
+      }
+      m_pInner->Send(HashTrailerSize, trailer);
+    }
+
+    virtual void Send(size_t cbData, const void *pData)
+    {
+      m_hash.Update(pData, cbData);
+      m_pInner->Send(cbData, pData);
+      m_offset+=cbData;
+    }
+
+    virtual void Recv(size_t , void *)
+    {
+      throw std::runtime_error("HashingOutStream::Recv - no such operation.");
+    }
+
+    virtual uint64_t SendOffset() const
+    { return m_offset; }
+
+    virtual uint64_t RecvOffset() const
+    { return 0; }
+  };
+
+}; // puzzler
+
+#endif
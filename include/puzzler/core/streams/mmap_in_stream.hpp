@@ -0,0 +1,165 @@
+#ifndef  puzzler_core_streams_mmap_in_hpp
+#define  puzzler_core_streams_mmap_in_hpp
+
+#include "puzzler/core/stream.hpp"
+#include "puzzler/core/util.hpp"
+
+#include <algorithm>
+
+#if !(defined(_WIN32) || defined(_WIN64)) || defined(__CYGWIN__)
+#include <sys/mman.h>
+#define PUZZLER_HAVE_MMAP 1
+#endif
+
+namespace puzzler{
+
+  /*! Maps a whole file into memory, and receives by advancing a cursor over it.
+      Recv is then a memcpy with no system call, and RecvView hands out
+      pointers straight into the mapping. Where mmap isn't available the file
+      is read into memory up front instead. Views stay valid as long as the
+      stream does.
+  */
+  class MmapInStream
+    : public Stream
+  {
+  private:
+    // No implementation for either
+    MmapInStream(const MmapInStream &); // = delete;
+    MmapInStream &operator=(const MmapInStream &); // = delete;
+
+    const uint8_t *m_data;
+    size_t m_size;
+    size_t m_offset;
+
+    void *m_map;                  // Set if m_data is a mapping
+    std::vector<uint8_t> m_copy;  // Else the contents are held here
+
+    void mLoad(int fd, const std::string &path)
+    {
+      struct stat info;
+      if(fstat(fd, &info)!=0)
+        throw std::runtime_error("MmapInStream - Couldn't stat file '"+path+"'");
+      m_size=info.st_size;
+
+#ifdef PUZZLER_HAVE_MMAP
+      if(m_size>0){
+        void *map=mmap(0, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(map!=MAP_FAILED){
+          m_map=map;
+          m_data=(const uint8_t*)map;
+          // We read front to back, so let the kernel read ahead aggressively
+          madvise(map, m_size, MADV_SEQUENTIAL);
+        }
+      }
+#endif
+      if(!m_map){
+        m_copy.resize(m_size);
+        if(lseek(fd, 0, SEEK_SET)!=0)
+          throw std::runtime_error("MmapInStream - Couldn't seek in file '"+path+"'");
+        size_t done=0;
+        while(done<m_size){
+          int got=read(fd, &m_copy[done], m_size-done);
+          if(got<=0)
+            throw std::runtime_error("MmapInStream - Couldn't read file '"+path+"'");
+          done+=got;
+        }
+        m_data=m_copy.empty() ? 0 : &m_copy[0];
+      }
+    }
+  public:
+    MmapInStream(std::string path)
+      : m_data(0)
+      , m_size(0)
+      , m_offset(0)
+      , m_map(0)
+    {
+      int fd=open(path.c_str(), O_RDONLY|O_BINARY);
+      if(fd==-1)
+        throw std::runtime_error("MmapInStream - Couldn't open file '"+path+"'");
+      try{
+        mLoad(fd, path);
+      }catch(...){
+        close(fd);
+        throw;
+      }
+      close(fd);
+    }
+
+    /*! Maps the regular file already open as fd, such as stdin redirected
+        from a file, starting from fd's current position. fd stays open and
+        its position is left alone. */
+    explicit MmapInStream(int fd)
+      : m_data(0)
+      , m_size(0)
+      , m_offset(0)
+      , m_map(0)
+    {
+      off_t pos=lseek(fd, 0, SEEK_CUR);
+      if(pos<0)
+        throw std::runtime_error("MmapInStream - Couldn't seek in file descriptor.");
+      mLoad(fd, "<fd "+std::to_string(fd)+">");
+      m_offset=std::min<size_t>(pos, m_size);
+    }
+
+    //! True if fd is a regular file, which can be mapped instead of read
+    static bool IsMappable(int fd)
+    {
+      struct stat info;
+      return fstat(fd, &info)==0 && S_ISREG(info.st_mode);
+    }
+
+    ~MmapInStream()
+    {
+#ifdef PUZZLER_HAVE_MMAP
+      if(m_map){
+        munmap(m_map, m_size);
+        m_map=0;
+      }
+#endif
+    }
+
+    //! Total size of the file
+    size_t Size() const
+    { return m_size; }
+
+    //! The whole file, independent of the cursor
+    const uint8_t *Data() const
+    { return m_data; }
+
+    virtual void Send(size_t , const void *)
+    {
+      throw std::runtime_error("MmapInStream::Send - no such operation.");
+    }
+
+    virtual void Recv(size_t cbData, void *pData)
+    {
+      memcpy(pData, RecvView(cbData), cbData);
+    }
+
+    virtual size_t RecvSome(size_t cbMax, void *pData)
+    {
+      size_t todo=std::min(cbMax, m_size-m_offset);
+      memcpy(pData, RecvView(todo), todo);
+      return todo;
+    }
+
+    virtual const void *RecvView(size_t cbData)
+    {
+      if(cbData > m_size-m_offset)
+        throw std::runtime_error("MmapInStream::Recv - End of file.");
+      const void *res=m_data+m_offset;
+      m_offset+=cbData;
+      return res;
+    }
+
+    //! Return the current offset from some arbitrary starting point
+    virtual uint64_t SendOffset() const
+    { return 0; }
+
+    virtual uint64_t RecvOffset() const
+    { return m_offset; }
+  };
+
+}; // puzzler
+
+#endif
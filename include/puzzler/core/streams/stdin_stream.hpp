@@ -41,6 +41,15 @@ namespace puzzler{
       }while(cbData>0);
     }
 
+    virtual size_t RecvSome(size_t cbMax, void *pData)
+    {
+      int got=read(STDIN_FILENO, pData, cbMax);
+      if(got<0)
+        throw std::runtime_error("StdinStream::RecvSome - Error while reading.");
+      m_offset+=got;
+      return got;
+    }
+
 
     //! Return the current offset from some arbitrary starting point
     virtual uint64_t SendOffset() const
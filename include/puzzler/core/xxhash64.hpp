@@ -0,0 +1,146 @@
+#ifndef puzzler_core_xxhash64_hpp
+#define puzzler_core_xxhash64_hpp
+
+#include <cstdint>
+#include <cstring>
+
+namespace puzzler{
+
+  /*! Streaming XXH64 (Yann Collet's xxHash, 64-bit variant). Bytes can be fed
+      in pieces of any size, and Digest gives the same value as hashing them
+      all at once with the reference implementation. Fast, but not meant to
+      resist anyone deliberately making collisions.
+  */
+  class XxHash64
+  {
+  private:
+    static const uint64_t P1=11400714785074694791ull;
+    static const uint64_t P2=14029467366897019727ull;
+    static const uint64_t P3=1609587929392839161ull;
+    static const uint64_t P4=9650029242287828579ull;
+    static const uint64_t P5=2870177450012600261ull;
+
+    uint64_t m_seed;
+    uint64_t m_acc[4];
+    uint64_t m_total;
+    uint8_t m_buffer[32];  // Bytes not yet making a full stripe
+    unsigned m_buffered;
+
+    static uint64_t mRotl(uint64_t x, unsigned r)
+    { return (x<<r) | (x>>(64-r)); }
+
+    // Input is little-endian whatever the host
+    static uint64_t mRead64(const uint8_t *p)
+    {
+      uint64_t x=0;
+      for(int i=7; i>=0; i--){
+        x=(x<<8) | p[i];
+      }
+      return x;
+    }
+
+    static uint32_t mRead32(const uint8_t *p)
+    { return p[0] | (uint32_t(p[1])<<8) | (uint32_t(p[2])<<16) | (uint32_t(p[3])<<24); }
+
+    static uint64_t mRound(uint64_t acc, uint64_t input)
+    {
+      acc+=input*P2;
+      acc=mRotl(acc, 31);
+      return acc*P1;
+    }
+
+    static uint64_t mMerge(uint64_t acc, uint64_t val)
+    {
+      acc^=mRound(0, val);
+      return acc*P1+P4;
+    }
+
+    void mStripe(const uint8_t *p)
+    {
+      for(unsigned i=0; i<4; i++){
+        m_acc[i]=mRound(m_acc[i], mRead64(p+8*i));
+      }
+    }
+  public:
+    explicit XxHash64(uint64_t seed=0)
+    { Reset(seed); }
+
+    void Reset(uint64_t seed=0)
+    {
+      m_seed=seed;
+      m_acc[0]=seed+P1+P2;
+      m_acc[1]=seed+P2;
+      m_acc[2]=seed;
+      m_acc[3]=seed-P1;
+      m_total=0;
+      m_buffered=0;
+    }
+
+    void Update(const void *pData, size_t cbData)
+    {
+      const uint8_t *p=(const uint8_t*)pData;
+      m_total+=cbData;
+
+      if(m_buffered+cbData < 32){
+        memcpy(m_buffer+m_buffered, p, cbData);
+        m_buffered+=cbData;
+        return;
+      }
+      if(m_buffered){
+        unsigned todo=32-m_buffered;
+        memcpy(m_buffer+m_buffered, p, todo);
+        mStripe(m_buffer);
+        p+=todo;
+        cbData-=todo;
+        m_buffered=0;
+      }
+      while(cbData>=32){
+        mStripe(p);
+        p+=32;
+        cbData-=32;
+      }
+      memcpy(m_buffer, p, cbData);
+      m_buffered=cbData;
+    }
+
+    //! Hash of everything so far. More can still be added afterwards.
+    uint64_t Digest() const
+    {
+      uint64_t h;
+      if(m_total>=32){
+        h=mRotl(m_acc[0], 1)+mRotl(m_acc[1], 7)+mRotl(m_acc[2], 12)+mRotl(m_acc[3], 18);
+        for(unsigned i=0; i<4; i++){
+          h=mMerge(h, m_acc[i]);
+        }
+      }else{
+        h=m_seed+P5;
+      }
+      h+=m_total;
+
+      const uint8_t *p=m_buffer, *end=m_buffer+m_buffered;
+      for(; p+8<=end; p+=8){
+        h^=mRound(0, mRead64(p));
+        h=mRotl(h, 27)*P1+P4;
+      }
+      if(p+4<=end){
+        h^=uint64_t(mRead32(p))*P1;
+        h=mRotl(h, 23)*P2+P3;
+        p+=4;
+      }
+      for(; p<end; p++){
+        h^=(*p)*P5;
+        h=mRotl(h, 11)*P1;
+      }
+
+      h^=h>>33;
+      h*=P2;
+      h^=h>>29;
+      h*=P3;
+      h^=h>>32;
+      return h;
+    }
+  };
+
+}; // puzzler
+
+#endif
@@ -5,5 +5,11 @@
 #include "puzzler/core/streams/stdin_stream.hpp"
 #include "puzzler/core/streams/stdout_stream.hpp"
 #include "puzzler/core/streams/file_in_stream.hpp"
+#include "puzzler/core/streams/buffered_in_stream.hpp"
+#include "puzzler/core/streams/buffered_out_stream.hpp"
+#include "puzzler/core/streams/mmap_in_stream.hpp"
+#include "puzzler/core/streams/compressed_in_stream.hpp"
+#include "puzzler/core/streams/compressed_out_stream.hpp"
+#include "puzzler/core/streams/hashing_out_stream.hpp"
 
 #endif
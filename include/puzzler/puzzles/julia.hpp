@@ -5,6 +5,7 @@
 #include <sstream>
 #include <algorithm>
 #include <complex>
+#include <functional>
 
 #include "puzzler/core/puzzle.hpp"
 
@@ -65,6 +66,16 @@ namespace puzzler
       conn.SendOrRecv(pixels);
     }
 
+    /*! Start writing an output of count pixels without holding them: sends
+        everything up to the pixels, after which the caller must send exactly
+        count bytes with PersistContext::SendBytes. The result is the same as
+        Persist with pixels filled in. */
+    void SendPixelCount(PersistContext &conn, uint32_t count)
+    {
+      PersistHeader(conn);
+      conn.SendOrRecv(count);
+    }
+
     virtual bool Equals(const Output *output) const override
     {
       auto pOutput=As<JuliaOutput>(output);
@@ -170,6 +181,10 @@ namespace puzzler
     virtual std::string Name() const override
     { return "julia"; }
 
+    //! Equals compares every element exactly
+    virtual bool OutputsAreExact() const override
+    { return true; }
+
     virtual std::shared_ptr<Input> CreateInput(
 					       ILog *,
 					       int scale
@@ -189,6 +204,45 @@ namespace puzzler
       return params;
     }
 
+    //! Create the input for the frame at time t of an animation, using the same path for c as CreateInput
+    std::shared_ptr<JuliaInput> CreateFrameInput(
+                                                 unsigned width,
+                                                 unsigned height,
+                                                 unsigned maxIter,
+                                                 float t
+                                                 ) const
+    {
+      auto params=std::make_shared<JuliaInput>(this, width);
+
+      params->width=width;
+      params->height=height;
+      params->maxIter=maxIter;
+      params->c=chooseC(t);
+
+      return params;
+    }
+
+    /*! Render a sequence of frames, with outputs[i] the result for inputs[i].
+        onFrame(i) is called in order of i once outputs[i] is complete. It may run
+        while later frames are still being rendered, so it must only touch outputs[i].
+    */
+    virtual void ExecuteBatch(
+                              ILog *log,
+                              const std::vector<const JuliaInput*> &inputs,
+                              const std::vector<JuliaOutput*> &outputs,
+                              std::function<void(unsigned)> onFrame
+                              ) const
+    {
+      if(inputs.size()!=outputs.size())
+        throw std::runtime_error("JuliaPuzzle::ExecuteBatch - inputs and outputs have different sizes.");
+
+      for(unsigned i=0; i<inputs.size(); i++){
+        Execute(log, inputs[i], outputs[i]);
+        if(onFrame)
+          onFrame(i);
+      }
+    }
+
   };
 
 };
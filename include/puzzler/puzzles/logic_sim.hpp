@@ -24,7 +24,7 @@ namespace puzzler
 
 
     uint32_t clockCycles;
-    std::vector<bool> inputState;
+    BitVector inputState;
 
 
     LogicSimInput(const Puzzle *puzzle, int scale)
@@ -56,7 +56,7 @@ namespace puzzler
     : public Puzzle::Output
   {
   public:
-    std::vector<bool> outputState;
+    BitVector outputState;
 
     LogicSimOutput(const Puzzle *puzzle, const Puzzle::Input *input)
       : Puzzle::Output(puzzle, input)
@@ -87,7 +87,7 @@ namespace puzzler
   {
   protected:
 
-    bool calcSrc(unsigned src, const std::vector<bool> &state, const LogicSimInput *input) const
+    bool calcSrc(unsigned src, const BitVector &state, const LogicSimInput *input) const
     {
       if(src < state.size()){
         return state.at(src);
@@ -99,11 +99,11 @@ namespace puzzler
       }
     }
 
-    std::vector<bool> next(const std::vector<bool> &state, const LogicSimInput *input) const
+    BitVector next(const BitVector &state, const LogicSimInput *input) const
     {
-      std::vector<bool> res(state.size());
+      BitVector res(state.size());
       for(unsigned i=0; i<res.size(); i++){
-        res[i]=calcSrc(input->flipFlopInputs[i], state, input);
+        res.Set(i, calcSrc(input->flipFlopInputs[i], state, input));
       }
       return res;
     }
@@ -123,7 +123,7 @@ namespace puzzler
 			  ) const
     {
       log->LogVerbose("About to start running clock cycles (total = %d", pInput->clockCycles);
-      std::vector<bool> state=pInput->inputState;
+      BitVector state=pInput->inputState;
       for(unsigned i=0; i<pInput->clockCycles; i++){
 	log->LogVerbose("Starting iteration %d of %d\n", i, pInput->clockCycles);
 
@@ -147,6 +147,34 @@ namespace puzzler
     virtual std::string Name() const override
     { return "logic_sim"; }
 
+    //! Equals compares every element exactly
+    virtual bool OutputsAreExact() const override
+    { return true; }
+
+    /*! Run the netlist and clockCycles of input from each of inputStates in
+        turn, ignoring input->inputState. outputStates[i] is the state reached
+        from inputStates[i].
+    */
+    virtual void ExecuteBatch(
+                              ILog *log,
+                              const LogicSimInput *input,
+                              const std::vector<BitVector> &inputStates,
+                              std::vector<BitVector> &outputStates
+                              ) const
+    {
+      outputStates.resize(inputStates.size());
+      for(unsigned i=0; i<inputStates.size(); i++){
+        if(inputStates[i].size()!=input->flipFlopInputs.size())
+          throw std::runtime_error("LogicSimPuzzle::ExecuteBatch - state size is inconsistent.");
+        log->LogVerbose("Running state %u of %u", i, (unsigned)inputStates.size());
+        BitVector state=inputStates[i];
+        for(unsigned c=0; c<input->clockCycles; c++){
+          state=next(state, input);
+        }
+        outputStates[i]=state;
+      }
+    }
+
     virtual std::shared_ptr<Input> CreateInput(
 					       ILog *,
 					       int scale
@@ -196,7 +224,7 @@ namespace puzzler
 
       params->inputState.resize(flipFlopCount);
       for(unsigned i=0; i<flipFlopCount; i++){
-        params->inputState[i] = 1 == (rnd()&1);
+        params->inputState.Set(i, 1 == (rnd()&1));
       }
 
       return params;
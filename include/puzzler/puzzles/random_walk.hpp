@@ -4,6 +4,7 @@
 #include <random>
 #include <sstream>
 #include <algorithm>
+#include <functional>
 
 #include "puzzler/core/puzzle.hpp"
 
@@ -28,6 +29,10 @@ namespace puzzler
     }
   };
 
+  /* The graph is held in compressed sparse row form: the edges of node i
+     are edges[offsets[i]] to edges[offsets[i+1]-1]. Loading fills these
+     two arrays directly, rather than allocating a vector per node. The wire
+     format is still a sequence of dd_node_t, in both v0 and v1. */
   class RandomWalkInput
     : public Puzzle::Input
   {
@@ -36,10 +41,13 @@ namespace puzzler
     uint32_t numSamples;
     uint32_t lengthWalks;
 
-    std::vector<dd_node_t> nodes;
+    std::vector<uint64_t> offsets;  // One per node, plus the total
+    std::vector<uint32_t> edges;
+    std::vector<uint32_t> counts;   // Initial count of each node
 
     RandomWalkInput(const Puzzle *puzzle, int scale)
       : Puzzle::Input(puzzle, scale)
+      , offsets(1, 0)
     {}
 
     RandomWalkInput(std::string format, std::string name, PersistContext &ctxt)
@@ -48,22 +56,210 @@ namespace puzzler
       PersistImpl(ctxt);
     }
 
+    uint32_t NumNodes() const
+    { return counts.size(); }
+
+    //! The graph as separate nodes, as the reference execution wants it
+    std::vector<dd_node_t> MakeNodes() const
+    {
+      std::vector<dd_node_t> nodes(NumNodes());
+      for(uint32_t i=0; i<nodes.size(); i++){
+        nodes[i].id=i;
+        nodes[i].edges.assign(edges.begin()+offsets[i], edges.begin()+offsets[i+1]);
+        nodes[i].count=counts[i];
+      }
+      return nodes;
+    }
+
+    typedef std::function<void (size_t n, const std::function<void (size_t)> &body)> ForEachChunkFn;
+
+    /*! Runs body(c) for each chunk c in [0,n) while loading the v1 format.
+        This is a plain loop, so the puzzle itself doesn't need TBB; the
+        provider replaces it with a parallel one. */
+    static ForEachChunkFn &ForEachChunk()
+    {
+      static ForEachChunkFn fn=[](size_t n, const std::function<void (size_t)> &body){
+        for(size_t c=0; c<n; c++){
+          body(c);
+        }
+      };
+      return fn;
+    }
+
     virtual void PersistImpl(PersistContext &conn) override final
     {
       conn.SendOrRecv(seed);
       conn.SendOrRecv(numSamples);
       conn.SendOrRecv(lengthWalks);
-      conn.SendOrRecv(nodes);
 
-      for(unsigned i=0; i<nodes.size(); i++){
-        if(nodes[i].id!=i)
+      if(Puzzle::IsNativeFormat(Format())){
+        mPersistChunked(conn);
+      }else{
+        mPersistNodes(conn);
+      }
+    }
+
+  private:
+    // Aim for chunks of about this many words, so there are plenty to share out
+    static const size_t ChunkWords=1<<16;
+    // Most edges the v0 loader will reserve before it has seen them
+    static const uint64_t MaxReserveEdges=uint64_t(1)<<28;
+
+    /* The v0 layout, as a std::vector<dd_node_t>. The total number of edges
+       isn't written anywhere, but generated graphs give every node the same
+       degree, so the edge array is reserved from the first node's degree and
+       only grows (geometrically) if later nodes have more. Each node is
+       checked as soon as it arrives. */
+    void mPersistNodes(PersistContext &conn)
+    {
+      uint32_t numNodes=NumNodes();
+      conn.SendOrRecv(numNodes);
+
+      if(!conn.IsSending()){
+        offsets.assign(1, 0);
+        offsets.reserve(uint64_t(numNodes)+1);
+        edges.clear();
+        counts.resize(numNodes);
+      }
+
+      for(uint32_t i=0; i<numNodes; i++){
+        uint32_t id=i;
+        uint32_t degree = conn.IsSending() ? offsets[i+1]-offsets[i] : 0;
+        conn.SendOrRecv(id);
+        conn.SendOrRecv(degree);
+        if(!conn.IsSending()){
+          if(id!=i)
+            throw std::runtime_error("RandomWalkInput::Persist - ids are corrupt.");
+          if(i==0){
+            // Capped, so a corrupt degree can't reserve gigabytes before it is caught
+            edges.reserve(std::min<uint64_t>(uint64_t(numNodes)*degree, uint64_t(MaxReserveEdges)));
+          }
+          if(edges.size()+degree > edges.capacity())
+            edges.reserve(std::max<size_t>(2*edges.capacity(), edges.size()+degree));
+          edges.resize(edges.size()+degree);
+          offsets.push_back(edges.size());
+        }
+        if(degree)
+          conn.SendOrRecvArray(&edges[offsets[i]], degree);
+        conn.SendOrRecv(counts[i]);
+
+        if(!conn.IsSending()){
+          for(uint64_t j=offsets[i]; j<offsets[i+1]; j++){
+            if(edges[j] >= numNodes)
+              throw std::runtime_error("RandomWalkInput::Persist - edges are corrupt.");
+          }
+        }
+      }
+    }
+
+    /* Swaps, checks and decodes chunk c of the v1 layout, where words holds
+       all the chunks. Chunks write to disjoint parts of the arrays, so any
+       number can be decoded at once. */
+    void mDecodeChunk(size_t c, const uint32_t *words, uint32_t numNodes, uint32_t chunkNodes, const std::vector<uint64_t> &chunkEdges, bool swap)
+    {
+      uint32_t begin=c*chunkNodes, end=std::min<uint64_t>(begin+uint64_t(chunkNodes), numNodes);
+      const uint32_t *src=words+3*uint64_t(begin)+chunkEdges[c];
+      const uint32_t *srcEnd=words+3*uint64_t(end)+chunkEdges[c+1];
+      uint64_t dst=chunkEdges[c];
+
+      for(uint32_t i=begin; i<end; i++){
+        if(srcEnd-src < 3)
+          throw std::runtime_error("RandomWalkInput::Persist - chunk is corrupt.");
+        uint32_t header[2]={src[0], src[1]};
+        if(swap)
+          PersistContext::ByteSwap(header, 2);
+        if(header[0]!=i)
           throw std::runtime_error("RandomWalkInput::Persist - ids are corrupt.");
-        for(unsigned j=0; j<nodes[i].edges.size(); j++){
-          if(nodes[i].edges[j] >= nodes.size())
+        uint32_t degree=header[1];
+        if(degree > chunkEdges[c+1]-dst || uint64_t(srcEnd-src-3) < degree)
+          throw std::runtime_error("RandomWalkInput::Persist - chunk is corrupt.");
+
+        offsets[i]=dst;
+        std::copy(src+2, src+2+degree, edges.begin()+dst);
+        counts[i]=src[2+degree];
+        if(swap){
+          PersistContext::ByteSwap(&edges[dst], degree);
+          PersistContext::ByteSwap(&counts[i], 1);
+        }
+        for(uint64_t j=dst; j<dst+degree; j++){
+          if(edges[j] >= numNodes)
             throw std::runtime_error("RandomWalkInput::Persist - edges are corrupt.");
         }
+        src+=3+degree;
+        dst+=degree;
       }
+      if(src!=srcEnd)
+        throw std::runtime_error("RandomWalkInput::Persist - chunk is corrupt.");
+    }
 
+    /* The v1 layout, which is built to be loaded in parallel:
+         numNodes   : uint32
+         chunkNodes : uint32, nodes per chunk (the last may be short)
+         chunkEdges : vector<uint64>, edges before each chunk, plus the total
+         chunks     : each node as in v0 (id, edge count, edges, count), as
+                      uint32 words, with no padding
+       Chunk c starts 3*c*chunkNodes+chunkEdges[c] words into the chunks, so
+       once those are in memory every chunk can be swapped, checked and
+       decoded independently, straight into its own part of the arrays. */
+    void mPersistChunked(PersistContext &conn)
+    {
+      uint32_t numNodes=NumNodes();
+      uint32_t chunkNodes=0;
+      std::vector<uint64_t> chunkEdges;
+
+      if(!conn.IsSending()){
+        conn.SendOrRecv(numNodes);
+        conn.SendOrRecv(chunkNodes);
+        conn.SendOrRecv(chunkEdges);
+
+        if(numNodes && chunkNodes==0)
+          throw std::runtime_error("RandomWalkInput::Persist - chunk size is corrupt.");
+        size_t numChunks = numNodes ? 1+(numNodes-1)/chunkNodes : 0;
+        if(chunkEdges.size()!=numChunks+1 || chunkEdges[0]!=0)
+          throw std::runtime_error("RandomWalkInput::Persist - chunk index is corrupt.");
+        for(size_t c=0; c<numChunks; c++){
+          if(chunkEdges[c+1]<chunkEdges[c])
+            throw std::runtime_error("RandomWalkInput::Persist - chunk index is corrupt.");
+        }
+
+        std::vector<uint32_t> storage;
+        const uint32_t *words=conn.RecvWords(3*uint64_t(numNodes)+chunkEdges[numChunks], storage);
+        bool swap=conn.IsSwapping();
+
+        offsets.resize(uint64_t(numNodes)+1);
+        offsets[numNodes]=chunkEdges[numChunks];
+        edges.resize(chunkEdges[numChunks]);
+        counts.resize(numNodes);
+
+        ForEachChunk()(numChunks, [&](size_t c){
+          mDecodeChunk(c, words, numNodes, chunkNodes, chunkEdges, swap);
+        });
+      }else{
+        uint64_t avgWords=3+(numNodes ? offsets[numNodes]/numNodes : 0);
+        chunkNodes=std::max<uint64_t>(1, ChunkWords/avgWords);
+
+        size_t numChunks = numNodes ? 1+(numNodes-1)/chunkNodes : 0;
+        for(size_t c=0; c<=numChunks; c++){
+          chunkEdges.push_back(offsets[std::min<uint64_t>(c*uint64_t(chunkNodes), numNodes)]);
+        }
+
+        conn.SendOrRecv(numNodes);
+        conn.SendOrRecv(chunkNodes);
+        conn.SendOrRecv(chunkEdges);
+
+        std::vector<uint32_t> chunk;
+        for(size_t c=0; c<numChunks; c++){
+          uint32_t begin=c*chunkNodes, end=std::min<uint64_t>(begin+uint64_t(chunkNodes), numNodes);
+          chunk.clear();
+          for(uint32_t i=begin; i<end; i++){
+            chunk.push_back(i);
+            chunk.push_back(offsets[i+1]-offsets[i]);
+            chunk.insert(chunk.end(), edges.begin()+offsets[i], edges.begin()+offsets[i+1]);
+            chunk.push_back(counts[i]);
+          }
+          conn.SendOrRecvArray(&chunk[0], chunk.size());
+        }
+      }
     }
   };
 
@@ -141,7 +337,7 @@ namespace puzzler
     {
 
       // Take a copy, as we'll need to modify the "count" flags
-      std::vector<dd_node_t> nodes(pInput->nodes);
+      std::vector<dd_node_t> nodes(pInput->MakeNodes());
       
       log->Log(Log_Debug, [&](std::ostream &dst){
         dst<<"  Scale = "<<nodes.size()<<"\n";
@@ -195,6 +391,10 @@ namespace puzzler
     virtual std::string Name() const override
     { return "random_walk"; }
 
+    //! Equals compares every element exactly
+    virtual bool OutputsAreExact() const override
+    { return true; }
+
     virtual std::shared_ptr<Input> CreateInput(
 					       ILog *,
 					       int scale
@@ -208,16 +408,15 @@ namespace puzzler
       params->numSamples=scale;
       params->lengthWalks=scale;
 
-      params->nodes.resize(scale);
+      unsigned degree=1 + unsigned(sqrt(scale));
+      params->offsets.reserve(uint64_t(scale)+1);
+      params->edges.reserve(uint64_t(scale)*degree);
+      params->counts.assign(scale, 0);
       for(unsigned i=0; i<(unsigned)scale; i++){
-        unsigned degree=1 + unsigned(sqrt(scale));
-
-        params->nodes[i].id=i;
-        params->nodes[i].count=0;
-        params->nodes[i].edges.reserve(degree);
         for(unsigned j=0; j<degree; j++){
-          params->nodes[i].edges.push_back(rnd()%scale);
+          params->edges.push_back(rnd()%scale);
         }
+        params->offsets.push_back(params->edges.size());
       }
 
       return params;
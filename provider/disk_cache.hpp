@@ -0,0 +1,144 @@
+#ifndef disk_cache_hpp
+#define disk_cache_hpp
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+
+#if !(defined(_WIN32) || defined(_WIN64))
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Compiled kernels and JIT objects are cached on disk and later loaded and
+   run, so anyone who can write to the cache can run code as us. Caches
+   therefore live in a directory owned by the current user that nobody else
+   can write to, files in it are checked the same way before they are used,
+   and new files are only ever created with mkstemp.
+*/
+
+//! True if path exists, belongs to us, and nobody else can write to it
+inline bool DiskCacheIsPrivate(const std::string &path, bool isDir)
+{
+#if defined(_WIN32) || defined(_WIN64)
+  (void)path;
+  (void)isDir;
+  return false;
+#else
+  // A file must not be a symlink. A directory may be (e.g. ~/.cache on
+  // another disk), as long as what it points at passes the same checks.
+  struct stat info;
+  if((isDir ? stat(path.c_str(), &info) : lstat(path.c_str(), &info))!=0)
+    return false;
+  if(isDir ? !S_ISDIR(info.st_mode) : !S_ISREG(info.st_mode))
+    return false;
+  return info.st_uid==getuid() && (info.st_mode & (S_IWGRP|S_IWOTH))==0;
+#endif
+}
+
+//! Creates dir with mode 0700 if it doesn't exist, and checks it is private
+inline bool DiskCacheMakeDir(const std::string &dir)
+{
+#if defined(_WIN32) || defined(_WIN64)
+  (void)dir;
+  return false;
+#else
+  if(mkdir(dir.c_str(), 0700)!=0 && errno!=EEXIST)
+    return false;
+  return DiskCacheIsPrivate(dir, true);
+#endif
+}
+
+/*! The directory to cache in, created if needed, or "" if caching is off or
+    there is nowhere private. $envVar chooses the directory, and setting it
+    to "" turns caching off. Otherwise it is $XDG_CACHE_HOME/hpce, else
+    ~/.cache/hpce. */
+inline std::string DiskCacheDir(const char *envVar)
+{
+  std::string dir;
+  if(getenv(envVar)){
+    dir=getenv(envVar);
+  }else{
+    if(getenv("XDG_CACHE_HOME") && *getenv("XDG_CACHE_HOME")){
+      dir=getenv("XDG_CACHE_HOME");
+    }else if(getenv("HOME") && *getenv("HOME")){
+      dir=std::string(getenv("HOME"))+"/.cache";
+    }else{
+      return std::string();
+    }
+    if(!DiskCacheMakeDir(dir))
+      return std::string();
+    dir+="/hpce";
+  }
+  if(dir.empty() || !DiskCacheMakeDir(dir))
+    return std::string();
+  return dir;
+}
+
+/*! Makes a new private directory under $TMPDIR or /tmp, for things that
+    are needed on disk but not worth keeping. The caller removes it. */
+inline std::string DiskCacheTempDir()
+{
+#if defined(_WIN32) || defined(_WIN64)
+  throw std::runtime_error("DiskCacheTempDir - not supported on this platform.");
+#else
+  std::string name="/tmp";
+  if(getenv("TMPDIR") && *getenv("TMPDIR")){
+    name=getenv("TMPDIR");
+  }
+  name+="/hpce_XXXXXX";
+  std::vector<char> pattern(name.begin(), name.end());
+  pattern.push_back(0);
+  if(!mkdtemp(&pattern[0]))
+    throw std::runtime_error("DiskCacheTempDir - couldn't create '"+name+"'.");
+  return &pattern[0];
+#endif
+}
+
+/*! Writes cbData bytes to a new file called prefix, then six random
+    characters, then suffix, and returns its name. mkstemp creates it with
+    mode 0600 and fails rather than open anything that is already there,
+    so it can't be made to follow a symlink or clobber another file. */
+inline std::string DiskCacheWriteTemp(const std::string &prefix, const std::string &suffix, const void *pData, size_t cbData)
+{
+#if defined(_WIN32) || defined(_WIN64)
+  (void)prefix;
+  (void)suffix;
+  (void)pData;
+  (void)cbData;
+  throw std::runtime_error("DiskCacheWriteTemp - not supported on this platform.");
+#else
+  std::string name=prefix+"XXXXXX"+suffix;
+  std::vector<char> pattern(name.begin(), name.end());
+  pattern.push_back(0);
+  int fd=mkstemps(&pattern[0], suffix.size());
+  if(fd<0)
+    throw std::runtime_error("DiskCacheWriteTemp - couldn't create '"+name+"'.");
+  name=&pattern[0];
+
+  const char *p=(const char*)pData;
+  while(cbData>0){
+    ssize_t done=write(fd, p, cbData);
+    if(done<0){
+      if(errno==EINTR)
+        continue;
+      close(fd);
+      remove(name.c_str());
+      throw std::runtime_error("DiskCacheWriteTemp - couldn't write '"+name+"'.");
+    }
+    p+=done;
+    cbData-=done;
+  }
+  if(close(fd)!=0){
+    remove(name.c_str());
+    throw std::runtime_error("DiskCacheWriteTemp - couldn't write '"+name+"'.");
+  }
+  return name;
+#endif
+}
+
+#endif
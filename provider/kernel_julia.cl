@@ -1,9 +1,30 @@
-__kernel void kernel_julia(const float dx, const float dy, const unsigned maxIter, const float c_x, const float c_y, __global unsigned* dest){
-	
+// The host reference is compiled with strict IEEE float semantics, so don't
+// let the compiler fuse z*z+c into fma, or the escape iteration drifts.
+#pragma OPENCL FP_CONTRACT OFF
+
+#ifdef cl_khr_fp64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+/* std::abs(complex<float>) ends up in cabsf/hypotf, which on the reference
+   platform is evaluated in double and rounded once. OpenCL's hypot is only
+   accurate to 4ulp, which is enough to flip pixels right on the |z|==2 edge. */
+float julia_abs(float z_x, float z_y)
+{
+#ifdef cl_khr_fp64
+	double x=z_x, y=z_y;
+	return (float)sqrt(x*x+y*y);
+#else
+	return hypot(z_x, z_y);
+#endif
+}
+
+__kernel void kernel_julia(const float dx, const float dy, const unsigned maxIter, const float c_x, const float c_y, __global uchar* dest){
+
 	uint x=get_global_id(0);
-    uint y=get_global_id(1);
+	uint y=get_global_id(1);
 	uint w=get_global_size(0);
-	
+
 	// Map pixel to z_0
 	// complex_t z(-1.5f+x*dx, -1.5f+y*dy);
 	float z_x = -1.5f+x*dx, z_y = -1.5f+y*dy;
@@ -14,15 +35,17 @@ __kernel void kernel_julia(const float dx, const float dy, const unsigned maxIte
 
 	unsigned iter=0;
 	while(iter<maxIter){
-		//if(abs(z) > 2)
-		if(hypot(z_x, z_y) > 2){
+		if(julia_abs(z_x, z_y) > 2){
 			break;
 		}
-		// Anybody want to refine/tighten this?
-		//z = z*z + input->c;
-		z_x = z_x*z_x - z_y*z_y + c_x;
-		z_y = 2*z_x*z_y + c_y;
+		//z = z*z + input->c;  Both parts must come from the old z.
+		float n_x = (z_x*z_x - z_y*z_y) + c_x;
+		float n_y = (z_x*z_y + z_y*z_x) + c_y;
+		z_x=n_x;
+		z_y=n_y;
 		++iter;
 	}
-	dest[y*w+x] = iter;
-}
\ No newline at end of file
+	// Same mapping as the reference, including the wrap of 1+255 to 0.
+	// A band of rows starting at the global offset goes at the start of dest.
+	dest[(y-get_global_offset(1))*w+x] = (iter==maxIter) ? 0 : (uchar)(1+(iter%256));
+}
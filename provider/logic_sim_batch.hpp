@@ -0,0 +1,140 @@
+#ifndef logic_sim_batch_hpp
+#define logic_sim_batch_hpp
+
+#include "logic_sim_netlist.hpp"
+#include "logic_sim_period.hpp"
+
+#include "tbb/parallel_for.h"
+
+/* Bit-sliced simulation of many initial states over one netlist.
+
+   Every gate is an xor, which is a bitwise operation, so if each signal holds
+   one word with bit l belonging to state l then a single sweep of
+   LogicSimNetlist::Step advances every state in the word by one cycle.
+*/
+
+//! W words per signal, so 64*W independent states per sweep
+template<unsigned W>
+struct LogicSimLanes
+{
+  uint64_t w[W];
+
+  LogicSimLanes operator^(const LogicSimLanes &o) const
+  {
+    LogicSimLanes res;
+    for(unsigned i=0; i<W; i++){
+      res.w[i]=w[i]^o.w[i];
+    }
+    return res;
+  }
+
+  bool operator==(const LogicSimLanes &o) const
+  {
+    for(unsigned i=0; i<W; i++){
+      if(w[i]!=o.w[i])
+        return false;
+    }
+    return true;
+  }
+
+  void Set(unsigned lane, bool value)
+  {
+    if(value)
+      w[lane/64] |= uint64_t(1)<<(lane%64);
+  }
+
+  bool Get(unsigned lane) const
+  { return (w[lane/64]>>(lane%64))&1; }
+};
+
+//! Single word specialisation, so a batch of up to 64 pays for one word
+template<>
+struct LogicSimLanes<1>
+{
+  uint64_t w[1];
+
+  LogicSimLanes operator^(const LogicSimLanes &o) const
+  { LogicSimLanes res; res.w[0]=w[0]^o.w[0]; return res; }
+
+  bool operator==(const LogicSimLanes &o) const
+  { return w[0]==o.w[0]; }
+
+  void Set(unsigned lane, bool value)
+  { w[0] |= uint64_t(value)<<lane; }
+
+  bool Get(unsigned lane) const
+  { return (w[0]>>lane)&1; }
+};
+
+/* Run cycles clock cycles from each of inputStates[begin,end), which must be
+   at most 64*W states, writing the results to outputStates[begin,end). With
+   detectPeriod the trajectory of the whole group is watched for repeats,
+   which happens at a common multiple of the periods of its members. */
+template<unsigned W>
+void LogicSimRunLanes(
+  const LogicSimNetlist &netlist,
+  const std::vector<puzzler::BitVector> &inputStates,
+  std::vector<puzzler::BitVector> &outputStates,
+  unsigned begin, unsigned end,
+  uint64_t cycles,
+  bool detectPeriod
+){
+  typedef LogicSimLanes<W> lanes_t;
+  unsigned n=netlist.flipFlopCount;
+
+  lanes_t zero;
+  std::fill(zero.w, zero.w+W, 0);
+  std::vector<lanes_t> state(n, zero), next(n), values(netlist.SignalCount());
+  for(unsigned s=begin; s<end; s++){
+    if(inputStates[s].size()!=n)
+      throw std::runtime_error("LogicSimRunLanes - input state has the wrong number of flip-flops.");
+    for(unsigned i=0; i<n; i++){
+      state[i].Set(s-begin, inputStates[s][i]);
+    }
+  }
+
+  auto step=[&](std::vector<lanes_t> &curr){
+    netlist.Step(curr.data(), next.data(), values.data());
+    std::swap(curr, next);
+  };
+  if(detectPeriod){
+    state=LogicSimRunWithPeriod(state, cycles, step);
+  }else{
+    for(uint64_t i=0; i<cycles; i++){
+      step(state);
+    }
+  }
+
+  for(unsigned s=begin; s<end; s++){
+    outputStates[s]=puzzler::BitVector(n);
+    for(unsigned i=0; i<n; i++){
+      outputStates[s].Set(i, state[i].Get(s-begin));
+    }
+  }
+}
+
+/* outputStates[i] is the state after cycles clock cycles from inputStates[i].
+   States are packed 256 at a time (64 if that covers the whole batch), and
+   the groups run as independent TBB tasks. */
+inline void LogicSimRunBatch(
+  const LogicSimNetlist &netlist,
+  const std::vector<puzzler::BitVector> &inputStates,
+  std::vector<puzzler::BitVector> &outputStates,
+  uint64_t cycles,
+  bool detectPeriod
+){
+  unsigned count=inputStates.size();
+  outputStates.resize(count);
+  if(count<=64){
+    LogicSimRunLanes<1>(netlist, inputStates, outputStates, 0, count, cycles, detectPeriod);
+    return;
+  }
+
+  const unsigned Width=256;
+  tbb::parallel_for(0u, (count+Width-1)/Width, [&](unsigned g){
+    unsigned begin=g*Width, end=std::min(count, begin+Width);
+    LogicSimRunLanes<Width/64>(netlist, inputStates, outputStates, begin, end, cycles, detectPeriod);
+  });
+}
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef logic_sim_gf2_hpp
+#define logic_sim_gf2_hpp
+
+#include "logic_sim_netlist.hpp"
+#include "logic_sim_period.hpp"
+
+#include "tbb/parallel_for.h"
+
+/* Every gate is an xor, so one clock cycle is a linear map over GF(2):
+   state_{t+1} = M * state_t, where row i of M is the set of flip-flops whose
+   parity drives flip-flop i. States and rows are packed 64 bits per word,
+   with bit j in word j/64 at position j%64.
+*/
+class LogicSimBitMatrix
+{
+public:
+  unsigned n;
+  unsigned words;   // words per row
+  std::vector<uint64_t> bits;
+
+  explicit LogicSimBitMatrix(unsigned _n=0)
+    : n(_n)
+    , words((_n+63)/64)
+    , bits(size_t(_n)*((_n+63)/64), 0)
+  {}
+
+  uint64_t *Row(unsigned i)
+  { return &bits[size_t(i)*words]; }
+
+  const uint64_t *Row(unsigned i) const
+  { return &bits[size_t(i)*words]; }
+
+  /* Feed the flip-flops unit vectors 64 at a time through the netlist: with
+     flip-flop 64b+k holding bit k, the word arriving at flip-flop i is exactly
+     word b of row i. */
+  static LogicSimBitMatrix FromNetlist(const LogicSimNetlist &netlist)
+  {
+    unsigned n=netlist.flipFlopCount;
+    LogicSimBitMatrix res(n);
+
+    tbb::parallel_for(0u, res.words, [&](unsigned b){
+      std::vector<uint64_t> state(n, 0), next(n), values(netlist.SignalCount());
+      for(unsigned k=0; k<64 && 64*b+k<n; k++){
+        state[64*b+k]=uint64_t(1)<<k;
+      }
+      netlist.Step(state.data(), next.data(), values.data());
+      for(unsigned i=0; i<n; i++){
+        res.Row(i)[b]=next[i];
+      }
+    });
+
+    return res;
+  }
+
+  /* this*other. Rows of other are combined 8 at a time through a table of all
+     256 xor combinations ("method of four russians"), so each output row costs
+     n/8 row xors rather than up to n. */
+  LogicSimBitMatrix Multiply(const LogicSimBitMatrix &other) const
+  {
+    if(other.n!=n)
+      throw std::runtime_error("LogicSimBitMatrix::Multiply - size mismatch.");
+
+    LogicSimBitMatrix res(n);
+    std::vector<uint64_t> table(256*size_t(words));
+
+    for(unsigned base=0; base<n; base+=8){
+      unsigned span=std::min(8u, n-base);
+
+      std::fill(table.begin(), table.begin()+words, 0);
+      for(unsigned k=1; k<(1u<<span); k++){
+        unsigned low=__builtin_ctz(k);
+        const uint64_t *prev=&table[size_t(k&(k-1))*words];
+        const uint64_t *row=other.Row(base+low);
+        uint64_t *dst=&table[size_t(k)*words];
+        for(unsigned w=0; w<words; w++){
+          dst[w]=prev[w]^row[w];
+        }
+      }
+
+      tbb::parallel_for(tbb::blocked_range<unsigned>(0, n, 64), [&](const tbb::blocked_range<unsigned> &chunk){
+        for(unsigned i=chunk.begin(); i!=chunk.end(); i++){
+          unsigned sel=(Row(i)[base/64] >> (base%64)) & 0xFF;
+          if(sel==0)
+            continue;
+          const uint64_t *src=&table[size_t(sel)*words];
+          uint64_t *dst=res.Row(i);
+          for(unsigned w=0; w<words; w++){
+            dst[w]^=src[w];
+          }
+        }
+      });
+    }
+
+    return res;
+  }
+
+  /*! y = this*x, for packed vectors of words entries.
+      Bit i of y is the parity of row_i & x. The parities of the words are
+      combined with xor before a single parity at the end, which keeps the
+      inner loop a plain and/xor reduction the compiler can vectorise. Each
+      task owns whole output words, i.e. blocks of 64 rows. */
+  void Apply(const uint64_t *x, uint64_t *y) const
+  {
+    tbb::parallel_for(0u, words, [&](unsigned b){
+      unsigned end=std::min(n, 64*b+64);
+      uint64_t acc=0;
+      for(unsigned i=64*b; i<end; i++){
+        const uint64_t *row=Row(i);
+        uint64_t parity=0;
+        for(unsigned w=0; w<words; w++){
+          parity^=row[w]&x[w];
+        }
+        acc |= uint64_t(__builtin_parityll(parity)) << (i%64);
+      }
+      y[b]=acc;
+    });
+  }
+};
+
+/* state_{cycles} = M^cycles * state_0, by repeated squaring. This needs about
+   log2(cycles) squarings of an n*n bit matrix, independent of the gate count. */
+inline std::vector<uint64_t> LogicSimRunGF2(const LogicSimNetlist &netlist, std::vector<uint64_t> state, uint64_t cycles)
+{
+  if(cycles==0)
+    return state;
+
+  LogicSimBitMatrix power=LogicSimBitMatrix::FromNetlist(netlist);
+  std::vector<uint64_t> tmp(state.size());
+  while(true){
+    if(cycles&1){
+      power.Apply(state.data(), tmp.data());
+      std::swap(state, tmp);
+    }
+    cycles>>=1;
+    if(cycles==0)
+      break;
+    power=power.Multiply(power);
+  }
+  return state;
+}
+
+/* The per-cycle form of the same matrix: each cycle is n*words and+xor word
+   operations on the packed state, independent of how many gates make up the
+   fan-in cones. This wins over gate simulation when the cones are large. */
+inline std::vector<uint64_t> LogicSimRunMasks(const LogicSimNetlist &netlist, std::vector<uint64_t> state, uint64_t cycles, bool detectPeriod=false, uint64_t *pPeriod=0)
+{
+  if(cycles==0)
+    return state;
+
+  LogicSimBitMatrix masks=LogicSimBitMatrix::FromNetlist(netlist);
+  std::vector<uint64_t> next(state.size());
+  auto step=[&](std::vector<uint64_t> &curr){
+    masks.Apply(curr.data(), next.data());
+    std::swap(curr, next);
+  };
+
+  if(detectPeriod)
+    return LogicSimRunWithPeriod(state, cycles, step, pPeriod);
+
+  for(uint64_t i=0; i<cycles; i++){
+    step(state);
+  }
+  return state;
+}
+
+#endif
@@ -0,0 +1,291 @@
+#ifndef logic_sim_jit_hpp
+#define logic_sim_jit_hpp
+
+#include "logic_sim_netlist.hpp"
+#include "disk_cache.hpp"
+
+#include <sstream>
+
+#if !(defined(_WIN32) || defined(_WIN64))
+#include <dlfcn.h>
+#endif
+
+/* Compiles a netlist into straight-line C++ and loads it as a shared object.
+
+   The interpreter in LogicSimNetlist::Evaluate pays for loading and decoding
+   two indices per gate; the generated code has the indices baked in as
+   constants. Each signal is a uint64_t, so the same object runs one state
+   (in bit 0) or 64 independent states at once.
+
+   Objects are cached on disk by a hash of the netlist and compile command,
+   so a netlist that is simulated many times is only compiled once. Each
+   object embeds the netlist and command it was built from, which are
+   checked after loading, so a collision or a stale object is rebuilt. The compiler is $HPCE_JIT_CXX,
+   else "c++", with flags $HPCE_JIT_CXXFLAGS, else DefaultFlags. The cache
+   lives in $HPCE_JIT_CACHE_DIR, else a private per-user directory (see
+   DiskCacheDir), and objects are only loaded from it if nobody else could
+   have written them. Without a cache, objects are built in a private
+   temporary directory and thrown away once loaded.
+*/
+class LogicSimJit
+{
+private:
+  // Run cycles clock cycles on state[0..n), with values as SignalCount() words of scratch
+  typedef void (*run_func_t)(uint64_t *state, uint64_t *values, uint64_t cycles);
+
+  // Bump this whenever the generated code changes, to invalidate old objects
+  static const unsigned CodeVersion=1;
+
+  // Compile time grows faster than linearly with function size, so the gates
+  // are split into many small functions
+  static const unsigned StatementsPerPart=256;
+
+  /* Almost all of the time at -O1 goes on the memory-level redundancy and
+     dead store passes, which find nothing in this code. Turning them off cuts
+     compile time about five-fold for the same generated loop. */
+  static const char *DefaultFlags()
+  { return "-O1 -fno-tree-fre -fno-tree-dse"; }
+
+  void *m_handle;
+  run_func_t m_run;
+
+  LogicSimJit(const LogicSimJit &); // = delete;
+  LogicSimJit &operator=(const LogicSimJit &); // = delete;
+
+  /* Everything the generated code depends on, as words. Objects embed this
+     and the compile command, and are checked against them after loading, as
+     the file name is only a hash of them. */
+  static std::vector<uint32_t> mKey(const LogicSimNetlist &netlist)
+  {
+    std::vector<uint32_t> key;
+    key.reserve(3+2*netlist.gates.size()+netlist.flipFlopSrcs.size());
+    key.push_back(uint32_t(CodeVersion));
+    key.push_back(netlist.flipFlopCount);
+    key.push_back(netlist.gates.size());
+    for(unsigned i=0; i<netlist.gates.size(); i++){
+      key.push_back(netlist.gates[i].first);
+      key.push_back(netlist.gates[i].second);
+    }
+    key.insert(key.end(), netlist.flipFlopSrcs.begin(), netlist.flipFlopSrcs.end());
+    return key;
+  }
+
+  //! The compiler and flags, from HPCE_JIT_CXX and HPCE_JIT_CXXFLAGS
+  static std::string mCompileCommand()
+  {
+    std::string cxx="c++";
+    if(getenv("HPCE_JIT_CXX")){
+      cxx=getenv("HPCE_JIT_CXX");
+    }
+    std::string flags=DefaultFlags();
+    if(getenv("HPCE_JIT_CXXFLAGS")){
+      flags=getenv("HPCE_JIT_CXXFLAGS");
+    }
+    return cxx+" "+flags;
+  }
+
+  static uint64_t mHash(const std::vector<uint32_t> &key, const std::string &command)
+  {
+    uint64_t h=14695981039346656037ull;
+    auto mix=[&](uint64_t x, unsigned bytes){
+      for(unsigned i=0; i<bytes; i++){
+        h=(h^((x>>(8*i))&0xFF))*1099511628211ull;
+      }
+    };
+    for(unsigned i=0; i<key.size(); i++){
+      mix(key[i], 4);
+    }
+    for(unsigned i=0; i<command.size(); i++){
+      mix(uint8_t(command[i]), 1);
+    }
+    return h;
+  }
+
+  //! True if the loaded object was built from key with command
+  bool mMatches(const std::vector<uint32_t> &key, const std::string &command) const
+  {
+#if defined(_WIN32) || defined(_WIN64)
+    return false;
+#else
+    const uint64_t *keySize=(const uint64_t*)dlsym(m_handle, "logic_sim_key_size");
+    const uint32_t *keyWords=(const uint32_t*)dlsym(m_handle, "logic_sim_key");
+    const char *builtWith=(const char*)dlsym(m_handle, "logic_sim_command");
+    if(!keySize || !keyWords || !builtWith)
+      return false;
+    if(*keySize!=key.size() || memcmp(keyWords, &key[0], key.size()*4)!=0)
+      return false;
+    return command==builtWith;
+#endif
+  }
+
+  static void mGenerate(const LogicSimNetlist &netlist, const std::vector<uint32_t> &key, const std::string &command, std::ostream &dst)
+  {
+    unsigned n=netlist.flipFlopCount;
+    unsigned parts=(netlist.gates.size()+StatementsPerPart-1)/StatementsPerPart;
+
+    dst<<"#include <stdint.h>\n\n";
+
+    // What this was built from, for mMatches. The command is written as
+    // numbers so it needs no escaping.
+    dst<<"extern \"C\" const uint64_t logic_sim_key_size="<<key.size()<<"u;\n";
+    dst<<"extern \"C\" const uint32_t logic_sim_key[]={";
+    for(unsigned i=0; i<key.size(); i++){
+      dst<<(i==0 ? "\n  " : i%16 ? "," : ",\n  ")<<key[i]<<"u";
+    }
+    dst<<"\n};\n";
+    dst<<"extern \"C\" const char logic_sim_command[]={";
+    for(unsigned i=0; i<command.size(); i++){
+      dst<<int(command[i])<<",";
+    }
+    dst<<"0};\n\n";
+
+    for(unsigned p=0; p<parts; p++){
+      unsigned begin=p*StatementsPerPart;
+      unsigned end=std::min<size_t>(begin+StatementsPerPart, netlist.gates.size());
+      dst<<"static void part"<<p<<"(uint64_t *v)\n{\n";
+      for(unsigned i=begin; i<end; i++){
+        dst<<"  v["<<n+i<<"]=v["<<netlist.gates[i].first<<"]^v["<<netlist.gates[i].second<<"];\n";
+      }
+      dst<<"}\n\n";
+    }
+
+    dst<<"extern \"C\" void logic_sim_run(uint64_t *s, uint64_t *v, uint64_t cycles)\n{\n";
+    dst<<"  for(uint64_t c=0; c<cycles; c++){\n";
+    dst<<"    for(unsigned i=0; i<"<<n<<"u; i++){\n";
+    dst<<"      v[i]=s[i];\n";
+    dst<<"    }\n";
+    for(unsigned p=0; p<parts; p++){
+      dst<<"    part"<<p<<"(v);\n";
+    }
+    for(unsigned i=0; i<n; i++){
+      dst<<"    s["<<i<<"]=v["<<netlist.flipFlopSrcs[i]<<"];\n";
+    }
+    dst<<"  }\n}\n";
+  }
+
+#if !(defined(_WIN32) || defined(_WIN64))
+  // Build the object for netlist as base.so, where base is in a private directory
+  void mBuild(
+    puzzler::ILog *log,
+    const LogicSimNetlist &netlist,
+    const std::vector<uint32_t> &key,
+    const std::string &command,
+    const std::string &base
+  ){
+    std::string objName=base+".so";
+    log->LogVerbose("Generating code for %u gates into %s", (unsigned)netlist.gates.size(), objName.c_str());
+
+    std::ostringstream generated;
+    mGenerate(netlist, key, command, generated);
+    std::string source=generated.str();
+
+    // Build under unique names then rename, so concurrent builds never
+    // load a half-written object.
+    std::string srcName=DiskCacheWriteTemp(base+".", ".cpp", source.data(), source.size());
+    std::string tmpName;
+    try{
+      tmpName=DiskCacheWriteTemp(base+".", ".so", 0, 0);
+    }catch(...){
+      remove(srcName.c_str());
+      throw;
+    }
+
+    std::string cmd=command+" -shared -fPIC -o '"+tmpName+"' '"+srcName+"'";
+    int code=system(cmd.c_str());
+    remove(srcName.c_str());
+    // The linker creates the object with the umask, which may let the group write
+    if(code!=0 || chmod(tmpName.c_str(), 0700)!=0){
+      remove(tmpName.c_str());
+      throw std::runtime_error("LogicSimJit::Load - compile failed: "+cmd);
+    }
+    if(rename(tmpName.c_str(), objName.c_str())!=0){
+      remove(tmpName.c_str());
+      throw std::runtime_error("LogicSimJit::Load - couldn't move object to '"+objName+"'.");
+    }
+  }
+#endif
+
+public:
+  LogicSimJit()
+    : m_handle(0)
+    , m_run(0)
+  {}
+
+  ~LogicSimJit()
+  {
+#if !(defined(_WIN32) || defined(_WIN64))
+    if(m_handle){
+      dlclose(m_handle);
+      m_handle=0;
+    }
+#endif
+  }
+
+  //! Compile (or find in the cache) and load the code for netlist
+  void Load(puzzler::ILog *log, const LogicSimNetlist &netlist)
+  {
+#if defined(_WIN32) || defined(_WIN64)
+    throw std::runtime_error("LogicSimJit::Load - not supported on this platform.");
+#else
+    std::vector<uint32_t> key=mKey(netlist);
+    std::string command=mCompileCommand();
+
+    char name[64];
+    snprintf(name, sizeof(name), "/hpce_logic_sim_%016llx", (unsigned long long)mHash(key, command));
+
+    std::string dir=DiskCacheDir("HPCE_JIT_CACHE_DIR");
+    std::string objName=dir+name+".so";
+    if(!dir.empty() && DiskCacheIsPrivate(objName, false)){
+      m_handle=dlopen(objName.c_str(), RTLD_NOW | RTLD_LOCAL);
+      if(m_handle && !mMatches(key, command)){
+        log->LogVerbose("Cached %s was built from something else, rebuilding", objName.c_str());
+        dlclose(m_handle);
+        m_handle=0;
+      }
+    }
+
+    if(!m_handle && !dir.empty()){
+      mBuild(log, netlist, key, command, dir+name);
+      m_handle=dlopen(objName.c_str(), RTLD_NOW | RTLD_LOCAL);
+      if(!m_handle)
+        throw std::runtime_error(std::string("LogicSimJit::Load - dlopen failed: ")+dlerror());
+    }
+
+    if(!m_handle){
+      log->LogVerbose("No private cache directory, building in a temporary one.");
+      // A loaded object stays mapped after its file is removed
+      dir=DiskCacheTempDir();
+      objName=dir+name+".so";
+      try{
+        mBuild(log, netlist, key, command, dir+name);
+        m_handle=dlopen(objName.c_str(), RTLD_NOW | RTLD_LOCAL);
+      }catch(...){
+        rmdir(dir.c_str());
+        throw;
+      }
+      remove(objName.c_str());
+      rmdir(dir.c_str());
+      if(!m_handle)
+        throw std::runtime_error(std::string("LogicSimJit::Load - dlopen failed: ")+dlerror());
+    }
+
+    // A process that still has an old object at this path open gets that back from dlopen
+    if(!mMatches(key, command))
+      throw std::runtime_error("LogicSimJit::Load - '"+objName+"' doesn't match the netlist.");
+
+    m_run=(run_func_t)dlsym(m_handle, "logic_sim_run");
+    if(!m_run)
+      throw std::runtime_error("LogicSimJit::Load - logic_sim_run missing from '"+objName+"'.");
+#endif
+  }
+
+  //! Advance state by cycles. values must hold SignalCount() words.
+  void Run(uint64_t *state, uint64_t *values, uint64_t cycles) const
+  {
+    if(!m_run)
+      throw std::runtime_error("LogicSimJit::Run - no code loaded.");
+    m_run(state, values, cycles);
+  }
+};
+
+#endif
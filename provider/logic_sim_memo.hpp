@@ -0,0 +1,120 @@
+#ifndef logic_sim_memo_hpp
+#define logic_sim_memo_hpp
+
+#include "puzzler/puzzles/logic_sim.hpp"
+
+/* Drop-in replacement for LogicSimPuzzle::calcSrc and next, working straight
+   from a LogicSimInput with no compile step.
+
+   The reference recursion re-evaluates shared gates once per path that
+   reaches them, and deep netlists can overflow the call stack. Here each
+   gate's value is cached the first time it is computed, and the walk uses an
+   explicit stack. Rather than clearing the cache for every new state, each
+   entry is tagged with the epoch it was computed in, and starting a new
+   state just bumps the epoch.
+
+   Out of range indices throw std::out_of_range, as the .at calls in the
+   reference do. A combinational loop, which would recurse forever in the
+   reference, throws std::runtime_error.
+*/
+class LogicSimMemoEvaluator
+{
+private:
+  const puzzler::LogicSimInput *m_input;
+
+  // A gate is being evaluated if its tag is m_epoch, and done if m_epoch+1
+  std::vector<uint32_t> m_tags;
+  std::vector<uint8_t> m_values;
+  uint32_t m_epoch;
+
+  std::vector<unsigned> m_stack;
+
+  void mNewEpoch()
+  {
+    if(m_epoch >= 0xFFFFFFFCu){
+      std::fill(m_tags.begin(), m_tags.end(), 0);
+      m_epoch=0;
+    }
+    m_epoch+=2;
+  }
+
+  void mCheckGate(unsigned gate) const
+  {
+    if(gate >= m_tags.size())
+      throw std::out_of_range("LogicSimMemoEvaluator - xor gate index out of range.");
+  }
+
+  bool mEval(unsigned src, const puzzler::BitVector &state)
+  {
+    const unsigned n=state.size();
+    if(src < n)
+      return state.at(src);
+
+    const uint32_t busy=m_epoch, done=m_epoch+1;
+    auto value=[&](unsigned s) -> bool {
+      return s<n ? state.at(s) : m_values[s-n];
+    };
+
+    mCheckGate(src-n);
+    if(m_tags[src-n]==done)
+      return m_values[src-n];
+
+    m_stack.assign(1, src);
+    while(!m_stack.empty()){
+      unsigned curr=m_stack.back();
+      if(m_tags[curr-n]==done){
+        m_stack.pop_back();   // Pushed twice, e.g. by a gate x^x
+        continue;
+      }
+      const auto &in=m_input->xorGateInputs[curr-n];
+      m_tags[curr-n]=busy;
+
+      bool ready=true;
+      for(unsigned s : {unsigned(in.first), unsigned(in.second)}){
+        if(s<n)
+          continue;
+        mCheckGate(s-n);
+        if(m_tags[s-n]==done)
+          continue;
+        if(m_tags[s-n]==busy)
+          throw std::runtime_error("LogicSimMemoEvaluator - netlist contains a combinational loop.");
+        m_stack.push_back(s);
+        ready=false;
+      }
+      if(ready){
+        m_values[curr-n]=value(in.first) != value(in.second);
+        m_tags[curr-n]=done;
+        m_stack.pop_back();
+      }
+    }
+    return m_values[src-n];
+  }
+
+public:
+  explicit LogicSimMemoEvaluator(const puzzler::LogicSimInput *input)
+    : m_input(input)
+    , m_tags(input->xorGateInputs.size(), 0)
+    , m_values(input->xorGateInputs.size(), 0)
+    , m_epoch(0)
+  {}
+
+  //! Same result as LogicSimPuzzle::calcSrc
+  bool CalcSrc(unsigned src, const puzzler::BitVector &state)
+  {
+    mNewEpoch();
+    return mEval(src, state);
+  }
+
+  //! Same result as LogicSimPuzzle::next, evaluating each gate at most once
+  puzzler::BitVector Next(const puzzler::BitVector &state)
+  {
+    mNewEpoch();
+    puzzler::BitVector res(state.size());
+    for(unsigned i=0; i<res.size(); i++){
+      res.Set(i, mEval(m_input->flipFlopInputs[i], state));
+    }
+    return res;
+  }
+};
+
+#endif
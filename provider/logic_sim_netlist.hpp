@@ -0,0 +1,276 @@
+#ifndef logic_sim_netlist_hpp
+#define logic_sim_netlist_hpp
+
+#include "puzzler/puzzles/logic_sim.hpp"
+
+#include "tbb/parallel_for.h"
+
+#include <unordered_map>
+
+/* Flattened and levelised form of a LogicSimInput.
+
+   Signals are numbered with the flip-flops first, then the xor gates sorted
+   by level, where a gate's level is one more than the deepest of its inputs
+   and flip-flops are level 0. Gate g is signal flipFlopCount+g, and both of
+   its inputs are flip-flops or gates from earlier levels, so a single sweep
+   over the gates evaluates every gate exactly once per cycle.
+
+   Compile also simplifies the netlist, keeping only what can reach a
+   flip-flop input, so every engine built on this form does less work:
+   - a^a is 0, and x^0 is x;
+   - gates with the same pair of (simplified) inputs are merged;
+   - (x^y)^x folds to y.
+   If a flip-flop ends up driven by the constant 0, a single gate 0^0 on
+   flip-flop 0 provides it.
+*/
+class LogicSimNetlist
+{
+public:
+  unsigned flipFlopCount;
+
+  // Inputs of each gate, as signal indices
+  std::vector<std::pair<uint32_t,uint32_t> > gates;
+
+  // Gates of level l+1 are [levelStarts[l], levelStarts[l+1])
+  std::vector<uint32_t> levelStarts;
+
+  // Signal which drives each flip-flop
+  std::vector<uint32_t> flipFlopSrcs;
+
+  // Number of gates in the input, before simplification
+  unsigned inputGateCount;
+
+  LogicSimNetlist()
+    : flipFlopCount(0)
+    , inputGateCount(0)
+  {}
+
+  size_t SignalCount() const
+  { return flipFlopCount+gates.size(); }
+
+  void Compile(const puzzler::LogicSimInput *input)
+  {
+    const unsigned n=input->flipFlopInputs.size();
+    const unsigned g=input->xorGateInputs.size();
+    const unsigned total=n+g;
+    const uint32_t Zero=total;    // Stands for the constant 0 while simplifying
+
+    auto srcOf=[&](int32_t src) -> uint32_t {
+      if(src<0 || uint32_t(src)>=total)
+        throw std::runtime_error("LogicSimNetlist::Compile - source index out of range.");
+      return uint32_t(src);
+    };
+    auto inputsOf=[&](uint32_t gate) -> std::pair<uint32_t,uint32_t> {
+      const auto &in=input->xorGateInputs[gate-n];
+      return std::make_pair(srcOf(in.first), srcOf(in.second));
+    };
+
+    // Topological order of the gates reachable from a flip-flop input, from a
+    // post-order walk with an explicit stack so deep netlists can't overflow
+    // the call stack. mark is 1 while a gate waits for its inputs, 2 when done.
+    std::vector<uint32_t> order;
+    std::vector<uint8_t> mark(total, 0);
+    std::vector<uint32_t> stack;
+    for(unsigned i=0; i<n; i++){
+      uint32_t root=srcOf(input->flipFlopInputs[i]);
+      if(root<n || mark[root])
+        continue;
+      stack.push_back(root);
+      while(!stack.empty()){
+        uint32_t curr=stack.back();
+        if(mark[curr]==2){
+          stack.pop_back();
+          continue;
+        }
+        mark[curr]=1;
+
+        auto in=inputsOf(curr);
+        bool ready=true;
+        for(uint32_t src : {in.first, in.second}){
+          if(src<n || mark[src]==2)
+            continue;
+          if(mark[src]==1)
+            throw std::runtime_error("LogicSimNetlist::Compile - netlist contains a combinational loop.");
+          stack.push_back(src);
+          ready=false;
+        }
+        if(ready){
+          mark[curr]=2;
+          order.push_back(curr);
+          stack.pop_back();
+        }
+      }
+    }
+
+    // Simplify in topological order. alias maps every signal to the signal
+    // (or Zero) which carries its value; kept gates alias themselves.
+    std::vector<uint32_t> alias(total);
+    std::vector<std::pair<uint32_t,uint32_t> > keptInputs(total);
+    std::vector<uint8_t> isKept(total, 0);
+    std::unordered_map<uint64_t,uint32_t> byInputs;
+    for(unsigned i=0; i<n; i++){
+      alias[i]=i;
+    }
+    for(uint32_t curr : order){
+      auto in=inputsOf(curr);
+      uint32_t a=in.first<n ? in.first : alias[in.first];
+      uint32_t b=in.second<n ? in.second : alias[in.second];
+      if(a>b)
+        std::swap(a,b);
+
+      if(a==b){
+        alias[curr]=Zero;
+      }else if(b==Zero){
+        alias[curr]=a;
+      }else if(a>=n && isKept[a] && (keptInputs[a].first==b || keptInputs[a].second==b)){
+        alias[curr]= keptInputs[a].first==b ? keptInputs[a].second : keptInputs[a].first;
+      }else if(b>=n && isKept[b] && (keptInputs[b].first==a || keptInputs[b].second==a)){
+        alias[curr]= keptInputs[b].first==a ? keptInputs[b].second : keptInputs[b].first;
+      }else{
+        uint64_t key=(uint64_t(a)<<32) | b;
+        auto it=byInputs.find(key);
+        if(it!=byInputs.end()){
+          alias[curr]=it->second;
+        }else{
+          byInputs[key]=curr;
+          alias[curr]=curr;
+          keptInputs[curr]=std::make_pair(a,b);
+          isKept[curr]=1;
+        }
+      }
+    }
+
+    // Simplification can orphan gates, so find what is actually live now
+    std::vector<uint32_t> srcs(n);
+    std::vector<uint8_t> live(total, 0);
+    bool needZero=false;
+    for(unsigned i=0; i<n; i++){
+      uint32_t root=srcOf(input->flipFlopInputs[i]);
+      srcs[i]= root<n ? root : alias[root];
+      if(srcs[i]==Zero){
+        needZero=true;
+      }else if(srcs[i]>=n && !live[srcs[i]]){
+        live[srcs[i]]=1;
+        stack.push_back(srcs[i]);
+      }
+      while(!stack.empty()){
+        uint32_t curr=stack.back();
+        stack.pop_back();
+        for(uint32_t src : {keptInputs[curr].first, keptInputs[curr].second}){
+          if(src>=n && !live[src]){
+            live[src]=1;
+            stack.push_back(src);
+          }
+        }
+      }
+    }
+
+    // Level of each live gate; order is topological, so inputs come first
+    std::vector<uint32_t> level(total, 0);
+    uint32_t depth=needZero ? 1 : 0;
+    for(uint32_t curr : order){
+      if(live[curr]){
+        level[curr]=1+std::max(level[keptInputs[curr].first], level[keptInputs[curr].second]);
+        depth=std::max(depth, level[curr]);
+      }
+    }
+
+    // Counting sort of the live gates by level, with the zero gate first in level 1
+    levelStarts.assign(depth+1, 0);
+    if(needZero)
+      levelStarts[1]++;
+    for(uint32_t curr : order){
+      if(live[curr])
+        levelStarts[level[curr]]++;
+    }
+    uint32_t acc=0;
+    for(unsigned l=0; l<=depth; l++){
+      uint32_t count=levelStarts[l];
+      levelStarts[l]=acc;
+      acc+=count;
+    }
+
+    std::vector<uint32_t> remap(total+1);
+    std::vector<uint32_t> fill(levelStarts);
+    for(unsigned i=0; i<n; i++){
+      remap[i]=i;
+    }
+    if(needZero)
+      remap[Zero]=n+fill[1]++;
+    for(uint32_t curr : order){
+      if(live[curr])
+        remap[curr]=n+fill[level[curr]]++;
+    }
+    // Level 0 holds no gates, so drop it from the index
+    levelStarts.erase(levelStarts.begin());
+    levelStarts.push_back(acc);
+
+    flipFlopCount=n;
+    inputGateCount=g;
+    gates.resize(acc);
+    if(needZero)
+      gates[remap[Zero]-n]=std::make_pair(0u, 0u);
+    for(uint32_t curr : order){
+      if(live[curr])
+        gates[remap[curr]-n]=std::make_pair(remap[keptInputs[curr].first], remap[keptInputs[curr].second]);
+    }
+    flipFlopSrcs.resize(n);
+    for(unsigned i=0; i<n; i++){
+      flipFlopSrcs[i]=remap[srcs[i]];
+    }
+  }
+
+  /* Levels (or runs of flip-flops) at least this wide are split across TBB
+     workers in chunks of ParallelGrain. Gates within a level only read earlier
+     levels, so the only synchronisation needed is the join after each level.
+     Narrower levels are swept serially, as a fork/join would cost more than
+     the xors. */
+  static const unsigned ParallelWidth=8192;
+  static const unsigned ParallelGrain=2048;
+
+  /* Evaluate all gates, given the flip-flop values in values[0..flipFlopCount).
+     T is uint8_t for a single state, or a word type to run many states at once. */
+  template<class T>
+  void Evaluate(T *values) const
+  {
+    T *gateValues=values+flipFlopCount;
+    const std::pair<uint32_t,uint32_t> *pGates=gates.data();
+
+    for(unsigned l=0; l+1<levelStarts.size(); l++){
+      unsigned begin=levelStarts[l], end=levelStarts[l+1];
+      if(end-begin < ParallelWidth){
+        for(unsigned i=begin; i<end; i++){
+          gateValues[i] = values[pGates[i].first] ^ values[pGates[i].second];
+        }
+      }else{
+        tbb::parallel_for(tbb::blocked_range<unsigned>(begin, end, ParallelGrain), [&](const tbb::blocked_range<unsigned> &chunk){
+          for(unsigned i=chunk.begin(); i!=chunk.end(); i++){
+            gateValues[i] = values[pGates[i].first] ^ values[pGates[i].second];
+          }
+        }, tbb::simple_partitioner());
+      }
+    }
+  }
+
+  //! Advance one clock cycle. values is scratch space of SignalCount() entries.
+  template<class T>
+  void Step(const T *state, T *next, T *values) const
+  {
+    std::copy(state, state+flipFlopCount, values);
+    Evaluate(values);
+    const uint32_t *pSrcs=flipFlopSrcs.data();
+    if(flipFlopCount < ParallelWidth){
+      for(unsigned i=0; i<flipFlopCount; i++){
+        next[i]=values[pSrcs[i]];
+      }
+    }else{
+      tbb::parallel_for(tbb::blocked_range<unsigned>(0, flipFlopCount, ParallelGrain), [&](const tbb::blocked_range<unsigned> &chunk){
+        for(unsigned i=chunk.begin(); i!=chunk.end(); i++){
+          next[i]=values[pSrcs[i]];
+        }
+      }, tbb::simple_partitioner());
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef logic_sim_period_hpp
+#define logic_sim_period_hpp
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+//! 128-bit fingerprint of a state, only used to avoid most full compares
+struct logic_sim_hash_t
+{
+  uint64_t lo, hi;
+
+  bool operator==(const logic_sim_hash_t &o) const
+  { return lo==o.lo && hi==o.hi; }
+};
+
+template<class T>
+logic_sim_hash_t LogicSimHashState(const std::vector<T> &state)
+{
+  const uint8_t *p=(const uint8_t*)state.data();
+  size_t len=state.size()*sizeof(T);
+
+  logic_sim_hash_t h={0x243F6A8885A308D3ull, 0x13198A2E03707344ull^len};
+  for(size_t i=0; i<len; i+=8){
+    uint64_t w=0;
+    memcpy(&w, p+i, std::min(size_t(8), len-i));
+    h.lo=(h.lo^w)*0x9E3779B97F4A7C15ull;
+    h.lo^=h.lo>>29;
+    h.hi=(h.hi+w)*0xC2B2AE3D27D4EB4Full;
+    h.hi=(h.hi<<31)|(h.hi>>33);
+  }
+  return h;
+}
+
+/* Run step cycles times, watching for the trajectory to repeat.
+
+   The system is deterministic with finitely many states, so it eventually
+   enters a loop. This uses Brent's scheme: remember the state at t0, and if
+   it comes back at t then the period is t-t0; if it hasn't come back after
+   2^k steps, remember the current state instead and double the window. Once
+   the period p is known, state_cycles = state_{t + (cycles-t)%p}, so we only
+   need the remaining steps modulo p. Total work is roughly the pre-period
+   plus a couple of periods, rather than cycles.
+
+   step(state) advances state by one cycle in place. If pPeriod is given, it
+   receives the period, or 0 if none was found within cycles.
+*/
+template<class TState, class TStep>
+TState LogicSimRunWithPeriod(TState state, uint64_t cycles, TStep step, uint64_t *pPeriod=0)
+{
+  if(pPeriod)
+    *pPeriod=0;
+
+  TState saved=state;
+  logic_sim_hash_t savedHash=LogicSimHashState(saved);
+  uint64_t savedAt=0, window=1;
+
+  uint64_t t=0;
+  while(t<cycles){
+    step(state);
+    t++;
+
+    logic_sim_hash_t hash=LogicSimHashState(state);
+    if(hash==savedHash && state==saved){
+      uint64_t period=t-savedAt;
+      if(pPeriod)
+        *pPeriod=period;
+      for(uint64_t i=(cycles-t)%period; i>0; i--){
+        step(state);
+      }
+      return state;
+    }
+
+    if(t-savedAt==window){
+      saved=state;
+      savedHash=hash;
+      savedAt=t;
+      window*=2;
+    }
+  }
+  return state;
+}
+
+#endif
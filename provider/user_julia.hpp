@@ -3,17 +3,23 @@
 
 #include "puzzler/puzzles/julia.hpp"
 
+#include "disk_cache.hpp"
+
 #define __CL_ENABLE_EXCEPTIONS 	//For openCl wrappers
 #include "CL/cl.hpp"
 
+#include "tbb/parallel_for.h"
+#include "tbb/pipeline.h"
+
 #include <fstream>		//To read in kernel files
 #include <streambuf>
+#include <mutex>
 
 class JuliaProvider
   : public puzzler::JuliaPuzzle
 {
 private:
-	std::string LoadSource(const char *fileName)
+	std::string LoadSource(const char *fileName) const
 	{
 		// TODO : Don't forget to change your_login here
 		std::string baseDir="provider";
@@ -34,138 +40,460 @@ private:
 			std::istreambuf_iterator<char>()
 		);
 	}
-	std::vector<cl::Device> devices;
-	cl::Device device;		//order of declaration matters in the following lambda in initializer!!!
-	cl::Context context;
-	cl::Program::Sources sources; 
-	cl::Program program;
-	cl::Kernel kernel;
-public:
-	JuliaProvider() : devices(), device() ,context([&](){
-				// Platform
-			std::vector<cl::Platform> platforms;
-
-			cl::Platform::get(&platforms);
-			if(platforms.size()==0)
-				throw std::runtime_error("No OpenCL platforms found.");
-
-			
-			/*std::cerr<<"Found "<<platforms.size()<<" platforms\n";
-			for(unsigned i=0;i<platforms.size();i++){
-				std::string vendor=platforms[i].getInfo<CL_PLATFORM_VENDOR>();
-				std::cerr<<"  Platform "<<i<<" : "<<vendor<<"\n";
-			}
-			*/
-			
-			int selectedPlatform=0;
-			if(getenv("HPCE_SELECT_PLATFORM")){
-				selectedPlatform=atoi(getenv("HPCE_SELECT_PLATFORM"));
-			}
-			//std::cerr<<"Choosing platform "<<selectedPlatform<<"\n";
-			cl::Platform platform=platforms.at(selectedPlatform); 
-			
-			// Device
-			//std::vector<cl::Device> devices;
-			platform.getDevices(CL_DEVICE_TYPE_ALL, &devices);  
-			if(devices.size()==0){
-				throw std::runtime_error("No opencl devices found.\n");
-			}
-			/*
-			std::cerr<<"Found "<<devices.size()<<" devices\n";
-			for(unsigned i=0;i<devices.size();i++){
-				std::string name=devices[i].getInfo<CL_DEVICE_NAME>();
-				std::cerr<<"  Device "<<i<<" : "<<name<<"\n";
-			}*/
-			
-			int selectedDevice=0;
-			if(getenv("HPCE_SELECT_DEVICE")){
-				selectedDevice=atoi(getenv("HPCE_SELECT_DEVICE"));
-			}
-			//std::cerr<<"Choosing device "<<selectedDevice<<"\n";
-			this->device=devices.at(selectedDevice);
-			
-			return devices;
-			// Context
-			//cl::Context context(devices);
-			}()), 
-		sources(),
-		program(context, [&](){
-			std::string kernelSource=LoadSource("kernel_julia.cl");
-
-			//cl::Program::Sources sources;   // A vector of (data,length) pairs
-			sources.push_back(std::make_pair(kernelSource.c_str(), kernelSource.size()+1)); // push on our single string
-
-			//cl::Program program(this->context, sources);
-			return sources;
-		}()),
-		kernel([&](){
-			/*
-			// Platform
-			std::vector<cl::Platform> platforms;
-
-			cl::Platform::get(&platforms);
-			if(platforms.size()==0)
-				throw std::runtime_error("No OpenCL platforms found.");
-
-			
-			std::cerr<<"Found "<<platforms.size()<<" platforms\n";
-			for(unsigned i=0;i<platforms.size();i++){
-				std::string vendor=platforms[i].getInfo<CL_PLATFORM_VENDOR>();
-				std::cerr<<"  Platform "<<i<<" : "<<vendor<<"\n";
-			}
-			
-			
-			int selectedPlatform=0;
-			if(getenv("HPCE_SELECT_PLATFORM")){
-				selectedPlatform=atoi(getenv("HPCE_SELECT_PLATFORM"));
-			}
-			std::cerr<<"Choosing platform "<<selectedPlatform<<"\n";
-			cl::Platform platform=platforms.at(selectedPlatform); 
-			
-			// Device
-			std::vector<cl::Device> devices;
-			platform.getDevices(CL_DEVICE_TYPE_ALL, &devices);  
-			if(devices.size()==0){
-				throw std::runtime_error("No opencl devices found.\n");
-			}
-			
-			std::cerr<<"Found "<<devices.size()<<" devices\n";
-			for(unsigned i=0;i<devices.size();i++){
-				std::string name=devices[i].getInfo<CL_DEVICE_NAME>();
-				std::cerr<<"  Device "<<i<<" : "<<name<<"\n";
+
+	/* OpenCL is only set up by the first Execute that needs it, under m_initOnce,
+	   so tools that never render a julia frame don't pay for platform discovery
+	   and kernel compilation. Hence everything below is mutable. */
+	mutable std::once_flag m_initOnce;
+	mutable std::vector<cl::Device> devices;
+	mutable cl::Device device;
+	mutable cl::Context context;
+	mutable cl::Program program;
+
+	// Set if the OpenCL setup failed, in which case we render on the CPU.
+	mutable std::string m_deviceError;
+
+	// The queue, kernel arguments and the output buffer are shared between
+	// calls, so they are guarded by m_lock.
+	mutable std::mutex m_lock;
+	mutable cl::Kernel kernel;
+	mutable cl::CommandQueue m_queue;
+	mutable cl::Buffer m_buffDest;
+	mutable size_t m_buffDestSize;
+
+	void mSelectDevice() const
+	{
+		// Platform
+		std::vector<cl::Platform> platforms;
+
+		cl::Platform::get(&platforms);
+		if(platforms.size()==0)
+			throw std::runtime_error("No OpenCL platforms found.");
+
+		int selectedPlatform=0;
+		if(getenv("HPCE_SELECT_PLATFORM")){
+			selectedPlatform=atoi(getenv("HPCE_SELECT_PLATFORM"));
+		}
+		cl::Platform platform=platforms.at(selectedPlatform);
+
+		// Device
+		platform.getDevices(CL_DEVICE_TYPE_ALL, &devices);
+		if(devices.size()==0){
+			throw std::runtime_error("No opencl devices found.\n");
+		}
+
+		int selectedDevice=0;
+		if(getenv("HPCE_SELECT_DEVICE")){
+			selectedDevice=atoi(getenv("HPCE_SELECT_DEVICE"));
+		}
+		device=devices.at(selectedDevice);
+	}
+
+	// FNV-1a, only used to name cache files, so it doesn't need to be strong
+	static uint64_t mHash(const std::string &data, uint64_t h=14695981039346656037ull)
+	{
+		for(unsigned i=0; i<data.size(); i++){
+			h=(h^uint8_t(data[i]))*1099511628211ull;
+		}
+		return h;
+	}
+
+	/* Built programs are cached on disk, as compiling the kernel on CPU runtimes
+	   costs hundreds of ms on every process start. The key covers the device,
+	   the driver, and the kernel source, so any change just misses the cache.
+	   On CPU runtimes the binary is native code, so it only goes in a private
+	   per-user directory (see DiskCacheDir). Set HPCE_CL_CACHE_DIR to choose
+	   another, or to "" to disable it. */
+	std::string mCacheKey(const std::string &kernelSource) const
+	{
+		std::string key=device.getInfo<CL_DEVICE_NAME>();
+		key+="\n"+device.getInfo<CL_DEVICE_VENDOR>();
+		key+="\n"+device.getInfo<CL_DRIVER_VERSION>();
+		key+="\n"+kernelSource;
+		return key;
+	}
+
+	std::string mCachePath(const std::string &key) const
+	{
+		std::string baseDir=DiskCacheDir("HPCE_CL_CACHE_DIR");
+		if(baseDir.empty())
+			return std::string();
+
+		char name[64];
+		snprintf(name, sizeof(name), "/hpce_julia_%016llx.clbin", (unsigned long long)mHash(key));
+		return baseDir+name;
+	}
+
+	/* The file name is only a hash of the key, so each file starts with the
+	   whole key it was built for, as "<key size>\n<key>", then the binary.
+	   Any other key, whether from a collision or a driver update, is a miss. */
+	bool mLoadCachedProgram(const std::string &path, const std::string &key) const
+	{
+		if(!DiskCacheIsPrivate(path, false))
+			return false;
+		std::ifstream src(path, std::ios::in | std::ios::binary);
+		if(!src.is_open())
+			return false;
+		std::string contents(
+			(std::istreambuf_iterator<char>(src)),
+			std::istreambuf_iterator<char>()
+		);
+
+		std::string header=std::to_string(key.size())+"\n";
+		if(contents.compare(0, header.size(), header)!=0)
+			return false;
+		if(contents.compare(header.size(), key.size(), key)!=0)
+			return false;
+		size_t offset=header.size()+key.size();
+		if(contents.size()<=offset)
+			return false;
+
+		// A stale or corrupt binary is just a cache miss
+		try{
+			std::vector<cl::Device> target(1, device);
+			cl::Program::Binaries binaries(1, std::make_pair(contents.data()+offset, contents.size()-offset));
+			program=cl::Program(context, target, binaries);
+			program.build(target);
+			return true;
+		}catch(cl::Error &){
+			return false;
+		}
+	}
+
+	void mSaveCachedProgram(const std::string &path, const std::string &key) const
+	{
+		try{
+			std::vector<size_t> sizes=program.getInfo<CL_PROGRAM_BINARY_SIZES>();
+			if(sizes.size()!=1 || sizes[0]==0)
+				return;
+
+			std::vector<char> binary(sizes[0]);
+			std::vector<char*> binaries(1, &binary[0]);
+			program.getInfo(CL_PROGRAM_BINARIES, &binaries);
+
+			std::string contents=std::to_string(key.size())+"\n"+key;
+			contents.append(&binary[0], binary.size());
+
+			// Write under a unique name then rename, so concurrent workers never see half a file
+			std::string tmpName=DiskCacheWriteTemp(path+".", "", contents.data(), contents.size());
+			if(rename(tmpName.c_str(), path.c_str())!=0)
+				remove(tmpName.c_str());
+		}catch(...){
+			// The cache is only an optimisation, the program is already built
+		}
+	}
+
+	void mBuildProgram() const
+	{
+		std::string kernelSource=LoadSource("kernel_julia.cl");
+
+		std::string cacheKey=mCacheKey(kernelSource);
+		std::string cachePath=mCachePath(cacheKey);
+		if(!cachePath.empty() && mLoadCachedProgram(cachePath, cacheKey))
+			return;
+
+		cl::Program::Sources sources;   // A vector of (data,length) pairs
+		sources.push_back(std::make_pair(kernelSource.c_str(), kernelSource.size()+1)); // push on our single string
+
+		// Only the selected device ever runs the kernel, so only build for that
+		std::vector<cl::Device> target(1, device);
+		program=cl::Program(context, sources);
+		try{
+			program.build(target);
+		}catch(...){
+			std::cerr<<"Log for device "<<device.getInfo<CL_DEVICE_NAME>()<<":\n\n";
+			std::cerr<<program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device)<<"\n\n";
+			throw;
+		}
+
+		if(!cachePath.empty())
+			mSaveCachedProgram(cachePath, cacheKey);
+	}
+
+	/* Both engines write the final pixel value (0 or 1+iter%256) straight
+	   into pDest, so there is no intermediate buffer of iteration counts.
+	   Rows [yBegin,yEnd) are rendered, with row yBegin at pDest. */
+	void mRenderCpu(
+		const puzzler::JuliaInput *input,
+		uint8_t *pDest,
+		unsigned yBegin,
+		unsigned yEnd
+	) const {
+		unsigned width=input->width, maxIter=input->maxIter;
+		puzzler::complex_t c=input->c;
+		float dx=3.0f/input->width, dy=3.0f/input->height;
+
+		pDest-=size_t(yBegin)*width;
+		tbb::parallel_for(yBegin, yEnd, [&](unsigned y){
+			for(unsigned x=0; x<width; x++){
+				// Same arithmetic as juliaFrameRender_Reference, so results are bit-exact
+				puzzler::complex_t z(-1.5f+x*dx, -1.5f+y*dy);
+
+				unsigned iter=0;
+				while(iter<maxIter){
+					if(abs(z) > 2){
+						break;
+					}
+					z = z*z + c;
+					++iter;
+				}
+				pDest[size_t(y)*width+x] = (iter==maxIter) ? 0 : (1+(iter%256));
 			}
-			
-			int selectedDevice=0;
-			if(getenv("HPCE_SELECT_DEVICE")){
-				selectedDevice=atoi(getenv("HPCE_SELECT_DEVICE"));
+		});
+	}
+
+	/* Queue up rows [yBegin,yEnd) of a frame and a non-blocking read into pDest,
+	   returning the event of the read. m_lock must be held by the caller. The
+	   queue is in-order, so the single device buffer can be reused by the next
+	   frame or band straight away. */
+	cl::Event mEnqueueOpenCL(
+		const puzzler::JuliaInput *input,
+		uint8_t *pDest,
+		unsigned yBegin,
+		unsigned yEnd
+	) const {
+		size_t destSize = size_t(input->width)*(yEnd-yBegin);
+		float dx=3.0f/input->width, dy=3.0f/input->height;
+
+		// Only grow the device buffer, so a run of same-sized frames
+		// never goes back to the allocator.
+		if(m_buffDestSize < destSize){
+			m_buffDest=cl::Buffer(context, CL_MEM_WRITE_ONLY, destSize);
+			m_buffDestSize=destSize;
+		}
+
+		/*
+		__kernel void kernel_julia(const float dx,	//0
+				const float dy, 	//1
+				const unsigned maxIter,	//2
+				const float c_x, //3
+				const float c_y, //4
+				__global uchar* dest){	//5
+		*/
+		kernel.setArg(0, dx);
+		kernel.setArg(1, dy);
+		kernel.setArg(2, input->maxIter);
+		kernel.setArg(3, input->c.real());
+		kernel.setArg(4, input->c.imag());
+		kernel.setArg(5, m_buffDest);
+
+		cl::NDRange offset(0, yBegin);          // The kernel writes row yBegin to the start of the buffer
+		cl::NDRange globalSize(input->width, yEnd-yBegin);   // Global size must match the original loops
+		cl::NDRange localSize=cl::NullRange; // We don't care about local size
+
+		cl::Event done;
+		m_queue.enqueueNDRangeKernel(kernel, offset, globalSize, localSize);
+		m_queue.enqueueReadBuffer(m_buffDest, CL_FALSE, 0, destSize, pDest, NULL, &done);
+		return done;
+	}
+
+	void mRenderOpenCL(
+		const puzzler::JuliaInput *input,
+		uint8_t *pDest
+	) const {
+		std::lock_guard<std::mutex> guard(m_lock);
+		mEnqueueOpenCL(input, pDest, 0, input->height).wait();
+	}
+
+	/* After an error part way through a batch, reads may still be queued into
+	   host memory that is freed as the error unwinds, so wait for everything
+	   on the queue first. m_lock must be held by the caller. */
+	void mDrainQueue() const
+	{
+		try{
+			m_queue.finish();
+		}catch(...){
+			// Keep the original error
+		}
+	}
+
+	// Frame k+1 is already queued on the device while the host hands frame k to onFrame.
+	void mBatchOpenCL(
+		const std::vector<const puzzler::JuliaInput*> &inputs,
+		const std::vector<puzzler::JuliaOutput*> &outputs,
+		const std::function<void(unsigned)> &onFrame
+	) const {
+		std::lock_guard<std::mutex> guard(m_lock);
+
+		std::vector<cl::Event> done(inputs.size());
+		try{
+			for(unsigned i=0; i<=inputs.size(); i++){
+				if(i<inputs.size()){
+					outputs[i]->pixels.resize(inputs[i]->width*inputs[i]->height);
+					if(!outputs[i]->pixels.empty()){
+						done[i]=mEnqueueOpenCL(inputs[i], &outputs[i]->pixels[0], 0, inputs[i]->height);
+					}
+					m_queue.flush();
+				}
+				if(i>0){
+					if(!outputs[i-1]->pixels.empty()){
+						done[i-1].wait();
+					}
+					if(onFrame)
+						onFrame(i-1);
+				}
 			}
-			std::cerr<<"Choosing device "<<selectedDevice<<"\n";
-			this->device=devices.at(selectedDevice);
-			
-			// Context
-			//cl::Context context(devices);
-			
-			
-			// Collect sources into program
-			std::string kernelSource=LoadSource("kernel_julia.cl");
-
-			cl::Program::Sources sources;   // A vector of (data,length) pairs
-			sources.push_back(std::make_pair(kernelSource.c_str(), kernelSource.size()+1)); // push on our single string
-
-			cl::Program program(this->context, sources);
-			*/
-			try{
-				program.build(devices);
-			}catch(...){
-				std::cerr<<"Error throwed at 0"<<"\n\n";
-				for(unsigned i=0;i<devices.size();i++){
-					std::cerr<<"Log for device "<<devices[i].getInfo<CL_DEVICE_NAME>()<<":\n\n";
-					std::cerr<<program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[i])<<"\n\n";
+		}catch(...){
+			mDrainQueue();
+			throw;
+		}
+	}
+
+	/* Up to maxLive frames are in flight: each one is spread over the shared TBB
+	   pool by mRenderCpu, and finished frames are passed to onFrame in order
+	   while later ones render. */
+	void mBatchCpu(
+		const std::vector<const puzzler::JuliaInput*> &inputs,
+		const std::vector<puzzler::JuliaOutput*> &outputs,
+		const std::function<void(unsigned)> &onFrame
+	) const {
+		const size_t maxLive=4;
+		unsigned next=0;
+
+		tbb::parallel_pipeline(maxLive,
+			tbb::make_filter<void,unsigned>(tbb::filter::serial_in_order, [&](tbb::flow_control &fc) -> unsigned {
+				if(next>=inputs.size()){
+					fc.stop();
+					return 0;
+				}
+				return next++;
+			})
+			&
+			tbb::make_filter<unsigned,unsigned>(tbb::filter::parallel, [&](unsigned i) -> unsigned {
+				outputs[i]->pixels.resize(inputs[i]->width*inputs[i]->height);
+				if(!outputs[i]->pixels.empty()){
+					mRenderCpu(inputs[i], &outputs[i]->pixels[0], 0, inputs[i]->height);
+				}
+				return i;
+			})
+			&
+			tbb::make_filter<unsigned,void>(tbb::filter::serial_in_order, [&](unsigned i){
+				if(onFrame)
+					onFrame(i);
+			})
+		);
+	}
+
+	// Streaming splits a frame into bands of rows of about 1MB each
+	static unsigned mBandRows(const puzzler::JuliaInput *input)
+	{
+		size_t bandBytes=1<<20;
+		return (unsigned)std::max<size_t>(1, bandBytes/std::max(1u, input->width));
+	}
+
+	/* Up to maxLive bands are queued, each read back into its own host buffer,
+	   and sent in order as their reads complete. */
+	void mStreamOpenCL(
+		const puzzler::JuliaInput *input,
+		puzzler::PersistContext &ctxt
+	) const {
+		std::lock_guard<std::mutex> guard(m_lock);
+
+		const unsigned maxLive=4;
+		unsigned rows=mBandRows(input);
+		unsigned bands=(input->height+rows-1)/rows;
+		std::vector<std::vector<uint8_t> > buffers(std::min(bands, maxLive));
+		std::vector<cl::Event> done(buffers.size());
+
+		// Reads still queued into buffers must finish before it is freed
+		try{
+			for(unsigned i=0; i<bands+buffers.size(); i++){
+				if(i<bands){
+					unsigned yBegin=i*rows, yEnd=std::min(input->height, yBegin+rows);
+					std::vector<uint8_t> &buffer=buffers[i%buffers.size()];
+					buffer.resize(size_t(input->width)*(yEnd-yBegin));
+					done[i%buffers.size()]=mEnqueueOpenCL(input, &buffer[0], yBegin, yEnd);
+					m_queue.flush();
+				}
+				// The band queued buffers.size()-1 steps ago is the oldest in flight
+				if(i+1>=buffers.size() && i+1-buffers.size()<bands){
+					unsigned j=i+1-buffers.size();
+					done[j%buffers.size()].wait();
+					const std::vector<uint8_t> &buffer=buffers[j%buffers.size()];
+					ctxt.SendBytes(&buffer[0], buffer.size());
 				}
-				throw;
 			}
-			return program;
-		}(),"kernel_julia"){}
+		}catch(...){
+			mDrainQueue();
+			throw;
+		}
+	}
+
+	/* The same window on the CPU, as a TBB pipeline: bands render in parallel
+	   (each spread over the pool by mRenderCpu) and are sent in order. With
+	   maxLive tokens the bands in flight are consecutive, so band i can use
+	   buffer i%maxLive. */
+	void mStreamCpu(
+		const puzzler::JuliaInput *input,
+		puzzler::PersistContext &ctxt
+	) const {
+		const size_t maxLive=4;
+		unsigned rows=mBandRows(input);
+		unsigned bands=(input->height+rows-1)/rows;
+		std::vector<std::vector<uint8_t> > buffers(maxLive);
+		unsigned next=0;
+
+		tbb::parallel_pipeline(maxLive,
+			tbb::make_filter<void,unsigned>(tbb::filter::serial_in_order, [&](tbb::flow_control &fc) -> unsigned {
+				if(next>=bands){
+					fc.stop();
+					return 0;
+				}
+				return next++;
+			})
+			&
+			tbb::make_filter<unsigned,unsigned>(tbb::filter::parallel, [&](unsigned i) -> unsigned {
+				unsigned yBegin=i*rows, yEnd=std::min(input->height, yBegin+rows);
+				std::vector<uint8_t> &buffer=buffers[i%maxLive];
+				buffer.resize(size_t(input->width)*(yEnd-yBegin));
+				mRenderCpu(input, &buffer[0], yBegin, yEnd);
+				return i;
+			})
+			&
+			tbb::make_filter<unsigned,void>(tbb::filter::serial_in_order, [&](unsigned i){
+				const std::vector<uint8_t> &buffer=buffers[i%maxLive];
+				ctxt.SendBytes(&buffer[0], buffer.size());
+			})
+		);
+	}
+
+	/* Only a machine with no OpenCL platform or device falls back to the CPU.
+	   Anything after that, such as the kernel failing to build, is a real
+	   error and is thrown, in which case the next call tries again. */
+	void mInitOpenCL() const
+	{
+		try{
+			mSelectDevice();
+		}catch(cl::Error &e){
+			m_deviceError=e.what();
+			return;
+		}catch(std::runtime_error &e){
+			m_deviceError=e.what();
+			return;
+		}
+		context=cl::Context(devices);
+		mBuildProgram();
+		kernel=cl::Kernel(program, "kernel_julia");
+		m_queue=cl::CommandQueue(context, device);
+	}
+
+	bool mUseOpenCL(puzzler::ILog *log) const
+	{
+		const char *engine=getenv("HPCE_JULIA_ENGINE");
+		if(engine && std::string(engine)=="cpu")
+			return false;
+
+		std::call_once(m_initOnce, [this](){ mInitOpenCL(); });
+		if(!m_deviceError.empty()){
+			log->LogInfo("OpenCL unavailable (%s), rendering on CPU.", m_deviceError.c_str());
+			return false;
+		}
+		return true;
+	}
+public:
+	JuliaProvider()
+		: m_buffDestSize(0)
+	{}
 
 	virtual void Execute(
 		       puzzler::ILog *log,
@@ -173,95 +501,79 @@ public:
 		       puzzler::JuliaOutput *output
 		       ) const override {
 		size_t destSize = input->width*input->height;
-		std::vector<unsigned> dest(destSize);
-	  
+
 		log->LogInfo("Starting");
-		/************************	Julia Implementation Starts Here		*******************************/
-		/*juliaFrameRender_Reference(
-		  input->width,     //! Number of pixels across
-		  input->height,    //! Number of rows of pixels
-		  input->c,        //! Constant to use in z=z^2+c calculation
-		  input->maxIter,   //! When to give up on a pixel
-		  &dest[0]     //! Array of width*height pixels, with pixel (x,y) at pDest[width*y+x]
-		);*/
-		
-		float dx=3.0f/input->width, dy=3.0f/input->height;
-		
-		cl::Buffer buffDest(context, CL_MEM_WRITE_ONLY, destSize);
-		/*
-		__kernel void kernel_xy(const float dx,	//0 
-				const float dy, 	//1
-				const unsigned maxIter,	//2 
-				const float c_x, //3
-				const float c_y, //4
-				__global unsigned* dest){	//5
-		*/
-		cl::Kernel mKernel(kernel);		//make a copy, since the function is const
-		mKernel.setArg(0, dx);
-		mKernel.setArg(1, dy);
-		mKernel.setArg(2, input->maxIter);
-		mKernel.setArg(3, input->c.real());
-		mKernel.setArg(4, input->c.imag());
-		mKernel.setArg(5, buffDest);
-		
-		cl::CommandQueue queue(context, device);
-		
-		std::cerr<<"REPEAT: Choosing device "<< device.getInfo<CL_DEVICE_NAME>()<<"\n";
-
-		cl::NDRange offset(0, 0);               // Always start iterations at x=0, y=0
-		cl::NDRange globalSize(input->width, input->height);   // Global size must match the original loops
-		cl::NDRange localSize=cl::NullRange; // We don't care about local size
 
-		for(unsigned t=0;t<destSize;t++){
-			queue.enqueueNDRangeKernel(mKernel, offset, globalSize, localSize);	
+		output->pixels.resize(destSize);
+		if(destSize>0){
+			if(mUseOpenCL(log)){
+				mRenderOpenCL(input, &output->pixels[0]);
+			}else{
+				mRenderCpu(input, &output->pixels[0], 0, input->height);
+			}
 		}
-		queue.enqueueBarrier();
-		queue.enqueueReadBuffer(buffDest, CL_TRUE, 0, destSize, &dest[0]);
-		/*
-        for(unsigned y=0; y<input->height; y++){
-            for(unsigned x=0; x<input->width; x++){
-                // Map pixel to z_0
-                complex_t z(-1.5f+x*dx, -1.5f+y*dy);
-
-                //Perform a julia iteration starting at the point z_0, for offset c.
-                //   z_{i+1} = z_{i}^2 + c
-                // The point escapes for the first i where |z_{i}| > 2.
-
-                unsigned iter=0;
-                while(iter<input->maxIter){
-                    if(abs(z) > 2){
-                        break;
-                    }
-                    // Anybody want to refine/tighten this?
-                    z = z*z + input->c;
-                    ++iter;
-                }
-                dest[y*input->width+x] = iter;
-            }
-        }
-		*/
-		/************************	Julia Implementation Ends Here		**********************************/
+
 		log->LogInfo("Mapping");
-	  
+
 		log->Log(puzzler::Log_Debug, [&](std::ostream &dst){
 			dst<<"\n";
 			for(unsigned y=0;y<input->height;y++){
 				for(unsigned x=0;x<input->width;x++){
-					unsigned got=dest[y*input->width+x];
+					unsigned got=output->pixels[y*input->width+x];
 					dst<<(got%9);
 				}
 				dst<<"\n";
 			}
 		});
 		log->LogVerbose("  c = %f,%f,  arg=%f\n", input->c.real(), input->c.imag(), std::arg(input->c));
-	  
-		output->pixels.resize(dest.size());
-		for(unsigned i=0; i<dest.size(); i++){
-			output->pixels[i] = (dest[i]==input->maxIter) ? 0 : (1+(dest[i]%256));
-		}
-	  
+
 		log->LogInfo("Finished");
 	}
+
+	/* Sends each band of rows as soon as it and those above it are done, so
+	   writing overlaps rendering, and only a few bands are ever held rather
+	   than the whole frame. The bytes are the same as Execute then Persist. */
+	virtual void ExecuteToStream(
+			puzzler::ILog *log,
+			const puzzler::Puzzle::Input *pInput,
+			puzzler::PersistContext &ctxt
+			) const override {
+		auto input=puzzler::As<puzzler::JuliaInput>(pInput);
+		auto output=MakeEmptyOutput(input);
+
+		uint64_t destSize = uint64_t(input->width)*input->height;
+		if(destSize>0xFFFFFFFFull)
+			throw std::runtime_error("JuliaProvider::ExecuteToStream - frame is too large to persist.");
+
+		log->LogInfo("Starting stream");
+		puzzler::As<puzzler::JuliaOutput>(output.get())->SendPixelCount(ctxt, uint32_t(destSize));
+		if(destSize>0){
+			if(mUseOpenCL(log)){
+				mStreamOpenCL(input, ctxt);
+			}else{
+				mStreamCpu(input, ctxt);
+			}
+		}
+		log->LogInfo("Finished stream");
+	}
+
+	virtual void ExecuteBatch(
+			puzzler::ILog *log,
+			const std::vector<const puzzler::JuliaInput*> &inputs,
+			const std::vector<puzzler::JuliaOutput*> &outputs,
+			std::function<void(unsigned)> onFrame
+			) const override {
+		if(inputs.size()!=outputs.size())
+			throw std::runtime_error("JuliaProvider::ExecuteBatch - inputs and outputs have different sizes.");
+
+		log->LogInfo("Starting batch of %u frames", (unsigned)inputs.size());
+		if(mUseOpenCL(log)){
+			mBatchOpenCL(inputs, outputs, onFrame);
+		}else{
+			mBatchCpu(inputs, outputs, onFrame);
+		}
+		log->LogInfo("Finished batch");
+	}
 };
 
 #endif
@@ -3,19 +3,217 @@
 
 #include "puzzler/puzzles/logic_sim.hpp"
 
+#include "logic_sim_netlist.hpp"
+#include "logic_sim_gf2.hpp"
+#include "logic_sim_jit.hpp"
+#include "logic_sim_batch.hpp"
+#include "logic_sim_memo.hpp"
+
+#include <cmath>
+
 class LogicSimProvider
   : public puzzler::LogicSimPuzzle
 {
+private:
+  /* With HPCE_LOGIC_SIM_PERIOD=1, the per-cycle engines hash each state and
+     skip ahead once the trajectory repeats. It is off by default, as the
+     per-cycle hash is wasted on circuits that don't repeat within the run. */
+  bool mDetectPeriod() const
+  {
+    const char *flag=getenv("HPCE_LOGIC_SIM_PERIOD");
+    return flag && std::string(flag)=="1";
+  }
+
+  puzzler::BitVector mRunCompiled(
+    puzzler::ILog *log,
+    const LogicSimNetlist &netlist,
+    const puzzler::BitVector &inputState,
+    uint64_t cycles
+  ) const {
+    unsigned n=netlist.flipFlopCount;
+    std::vector<uint8_t> state(n), next(n), values(netlist.SignalCount());
+    for(unsigned i=0; i<n; i++){
+      state[i]=inputState[i];
+    }
+
+    auto step=[&](std::vector<uint8_t> &curr){
+      netlist.Step(curr.data(), next.data(), values.data());
+      std::swap(curr, next);
+    };
+
+    if(mDetectPeriod()){
+      uint64_t period=0;
+      state=LogicSimRunWithPeriod(state, cycles, step, &period);
+      if(period)
+        log->LogVerbose("  state trajectory has period %llu", (unsigned long long)period);
+    }else{
+      for(uint64_t i=0; i<cycles; i++){
+        step(state);
+      }
+    }
+
+    puzzler::BitVector res(n);
+    for(unsigned i=0; i<n; i++){
+      res.Set(i, state[i]);
+    }
+    return res;
+  }
+
+  // Works from the input directly, without compiling the netlist
+  puzzler::BitVector mRunMemo(
+    const puzzler::LogicSimInput *input
+  ) const {
+    LogicSimMemoEvaluator evaluator(input);
+    puzzler::BitVector state=input->inputState;
+    for(unsigned i=0; i<input->clockCycles; i++){
+      state=evaluator.Next(state);
+    }
+    return state;
+  }
+
+  // The packed engines work on the state's words as they are
+  puzzler::BitVector mRunGF2(
+    const LogicSimNetlist &netlist,
+    const puzzler::BitVector &inputState,
+    uint64_t cycles
+  ) const {
+    std::vector<uint64_t> state=LogicSimRunGF2(netlist, inputState.Words(), cycles);
+    return puzzler::BitVector(std::move(state), netlist.flipFlopCount);
+  }
+
+  puzzler::BitVector mRunMasks(
+    puzzler::ILog *log,
+    const LogicSimNetlist &netlist,
+    const puzzler::BitVector &inputState,
+    uint64_t cycles
+  ) const {
+    uint64_t period=0;
+    std::vector<uint64_t> state=LogicSimRunMasks(netlist, inputState.Words(), cycles, mDetectPeriod(), &period);
+    if(period)
+      log->LogVerbose("  state trajectory has period %llu", (unsigned long long)period);
+    return puzzler::BitVector(std::move(state), netlist.flipFlopCount);
+  }
+
+  // Only used when asked for, as generating and compiling the code takes seconds
+  puzzler::BitVector mRunJit(
+    puzzler::ILog *log,
+    const LogicSimNetlist &netlist,
+    const puzzler::BitVector &inputState,
+    uint64_t cycles
+  ) const {
+    LogicSimJit jit;
+    jit.Load(log, netlist);
+
+    unsigned n=netlist.flipFlopCount;
+    std::vector<uint64_t> state(n), values(netlist.SignalCount());
+    for(unsigned i=0; i<n; i++){
+      state[i]=inputState[i];
+    }
+
+    if(mDetectPeriod()){
+      uint64_t period=0;
+      state=LogicSimRunWithPeriod(state, cycles, [&](std::vector<uint64_t> &curr){
+        jit.Run(curr.data(), values.data(), 1);
+      }, &period);
+      if(period)
+        log->LogVerbose("  state trajectory has period %llu", (unsigned long long)period);
+    }else{
+      jit.Run(state.data(), values.data(), cycles);
+    }
+
+    puzzler::BitVector res(n);
+    for(unsigned i=0; i<n; i++){
+      res.Set(i, state[i]&1);
+    }
+    return res;
+  }
+
+  /* Rough operation counts: simulation costs the gate count per cycle, the
+     dependency masks n*n/64 per cycle, and the matrix power is logarithmic in
+     cycles but cubic in flip-flops. HPCE_LOGIC_SIM_ENGINE overrides the choice. */
+  std::string mChooseEngine(const LogicSimNetlist &netlist, uint64_t cycles) const
+  {
+    if(getenv("HPCE_LOGIC_SIM_ENGINE")){
+      return getenv("HPCE_LOGIC_SIM_ENGINE");
+    }
+
+    double n=netlist.flipFlopCount, words=std::ceil(n/64);
+    double perCycle=netlist.SignalCount();
+    double simCost=cycles*perCycle;
+    double maskCost=words*perCycle + cycles*n*words;
+    double gf2Cost=words*perCycle + std::log2(double(cycles)+1)*n*words*(n+256)/8;
+
+    if(gf2Cost < simCost && gf2Cost < maskCost)
+      return "gf2";
+    return maskCost < simCost ? "masks" : "compiled";
+  }
+
 public:
   LogicSimProvider()
   {}
 
+  /*! Run input->clockCycles from input->inputState with the named engine,
+      given the netlist compiled from input. Public so that benchmarks can
+      time compilation and each engine separately. */
+  puzzler::BitVector RunEngine(
+                              puzzler::ILog *log,
+                              const std::string &engine,
+                              const puzzler::LogicSimInput *input,
+                              const LogicSimNetlist &netlist
+                              ) const {
+    if(engine=="reference"){
+      puzzler::LogicSimOutput output(this, input);
+      ReferenceExecute(log, input, &output);
+      return output.outputState;
+    }else if(engine=="memo"){
+      return mRunMemo(input);
+    }else if(engine=="compiled"){
+      return mRunCompiled(log, netlist, input->inputState, input->clockCycles);
+    }else if(engine=="masks"){
+      return mRunMasks(log, netlist, input->inputState, input->clockCycles);
+    }else if(engine=="jit"){
+      return mRunJit(log, netlist, input->inputState, input->clockCycles);
+    }else if(engine=="gf2"){
+      return mRunGF2(netlist, input->inputState, input->clockCycles);
+    }else{
+      throw std::runtime_error("LogicSimProvider::RunEngine - unknown engine '"+engine+"'.");
+    }
+  }
+
   virtual void Execute(
 		       puzzler::ILog *log,
 		       const puzzler::LogicSimInput *input,
 		       puzzler::LogicSimOutput *output
 		       ) const override {
-    return ReferenceExecute(log, input, output);
+    // The reference re-walks the whole fan-in cone of every flip-flop on every
+    // cycle. Compile once so each gate is evaluated once per cycle instead.
+    log->LogVerbose("Compiling netlist");
+    LogicSimNetlist netlist;
+    netlist.Compile(input);
+    log->LogVerbose("  %u flip-flops, %u of %u gates live, %u levels", netlist.flipFlopCount, (unsigned)netlist.gates.size(), netlist.inputGateCount, (unsigned)netlist.levelStarts.size()-1);
+
+    std::string engine=mChooseEngine(netlist, input->clockCycles);
+    log->LogVerbose("Running %u clock cycles with engine '%s'", input->clockCycles, engine.c_str());
+    output->outputState=RunEngine(log, engine, input, netlist);
+    log->LogVerbose("Finished clock cycles");
+  }
+
+  /* Compile once, then bit-slice the states so each sweep of the gates
+     advances up to 256 of them. */
+  virtual void ExecuteBatch(
+                            puzzler::ILog *log,
+                            const puzzler::LogicSimInput *input,
+                            const std::vector<puzzler::BitVector> &inputStates,
+                            std::vector<puzzler::BitVector> &outputStates
+                            ) const override {
+    log->LogVerbose("Compiling netlist");
+    LogicSimNetlist netlist;
+    netlist.Compile(input);
+    log->LogVerbose("  %u flip-flops, %u of %u gates live, %u levels", netlist.flipFlopCount, (unsigned)netlist.gates.size(), netlist.inputGateCount, (unsigned)netlist.levelStarts.size()-1);
+
+    log->LogVerbose("Running %u clock cycles for %u states", input->clockCycles, (unsigned)inputStates.size());
+    LogicSimRunBatch(netlist, inputStates, outputStates, input->clockCycles, mDetectPeriod());
+    log->LogVerbose("Finished clock cycles");
   }
 
 };
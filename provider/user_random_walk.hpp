@@ -9,7 +9,12 @@ class RandomWalkProvider
 {
 public:
   RandomWalkProvider()
-  {}
+  {
+    // Inputs in the v1 format are decoded a chunk at a time, so share them out
+    puzzler::RandomWalkInput::ForEachChunk()=[](size_t n, const std::function<void (size_t)> &body){
+      tbb::parallel_for(size_t(0), n, body, tbb::simple_partitioner());
+    };
+  }
 
   virtual void Execute(
 		       puzzler::ILog *log,
@@ -18,8 +23,10 @@ public:
 		       ) const override {
     
 				   //memory intensive, going to use tbb
-	// Take a copy, as we'll need to modify the "count" flags
-      std::vector<puzzler::dd_node_t> nodes(input->nodes);
+	// Counts are kept separately, so the graph can be walked in place
+      const std::vector<uint64_t> &offsets=input->offsets;
+      const std::vector<uint32_t> &edges=input->edges;
+      unsigned numNodes=input->NumNodes();
       /*
       log->Log(Log_Debug, [&](std::ostream &dst){
         dst<<"  Scale = "<<nodes.size()<<"\n";
@@ -37,7 +44,10 @@ public:
       log->LogVerbose("Starting random walks");
 		*/
 	  /************************************** Random Walk Implementation Starts	*************************/
-	  std::vector<tbb::atomic<uint32_t> > nodeCount(nodes.size(), 0);
+	  std::vector<tbb::atomic<uint32_t> > nodeCount(numNodes, 0);
+	  for(unsigned i=0; i<numNodes; i++){
+	    nodeCount[i]=input->counts[i];
+	  }
 	  
       // This gives the same sequence on all platforms
       std::mt19937 rng(input->seed);
@@ -46,7 +56,7 @@ public:
 	  
       for(unsigned i=0; i<input->numSamples; i++){
         seed[i]=rng();
-        start[i]=rng() % nodes.size();    // Choose a random node
+        start[i]=rng() % numNodes;    // Choose a random node
 	  }
 	  tbb::parallel_for(0u,(unsigned)input->numSamples,[&](unsigned i){
         //random_walk(nodes, seed[i], start[i], length);
@@ -56,10 +66,10 @@ public:
         for(unsigned k=0; k<length; k++){
           nodeCount[current]++;
 
-          unsigned edgeIndex = rng % nodes[current].edges.size();
+          unsigned edgeIndex = rng % (offsets[current+1]-offsets[current]);
           rng=rng*1664525+1013904223;	//step rng
         
-          current=nodes[current].edges[edgeIndex];
+          current=edges[offsets[current]+edgeIndex];
         }
 	  });
 
@@ -67,10 +77,10 @@ public:
       //log->LogVerbose("Done random walks, converting histogram");
 
       // Map the counts from the nodes back into an array
-      output->histogram.resize(nodes.size());
+      output->histogram.resize(numNodes);
       //for(unsigned i=0; i<nodes.size(); i++){
 	  //tbb::parallel_for(0u,(unsigned)nodes.size(),[&](unsigned i){
-	  tbb::parallel_for(tbb::blocked_range<unsigned>(0u,(unsigned)nodes.size(),4096), [&](const tbb::blocked_range<unsigned> &chunk){
+	  tbb::parallel_for(tbb::blocked_range<unsigned>(0u,numNodes,4096), [&](const tbb::blocked_range<unsigned> &chunk){
 		for(unsigned i=chunk.begin(); i!=chunk.end(); i++){
         output->histogram[i]=std::make_pair(uint32_t(nodeCount[i]),uint32_t(i));
         //nodes[i].count=0;
@@ -0,0 +1,150 @@
+#include "puzzler/puzzler.hpp"
+#include "puzzler/puzzles/logic_sim.hpp"
+
+#include "user_logic_sim.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <cmath>
+
+/* Gates are spread evenly over levels 1..depth. Each takes one input from the
+   level below, so the netlist really has that depth, and the other from any
+   earlier signal. Half the flip-flops are driven from the top level, the
+   rest from any signal. */
+std::shared_ptr<puzzler::LogicSimInput> MakeInput(
+   const puzzler::Puzzle *puzzle,
+   unsigned flipFlops, unsigned gates, unsigned depth, unsigned cycles,
+   unsigned seed
+){
+   std::mt19937 rnd(seed);
+
+   auto input=std::make_shared<puzzler::LogicSimInput>(puzzle, flipFlops);
+   input->clockCycles=cycles;
+
+   // Signals [levelStart[l], levelStart[l+1]) make up level l
+   depth=std::max(1u, std::min(depth, gates));
+   std::vector<unsigned> levelStart(depth+2);
+   levelStart[1]=flipFlops;
+   for(unsigned l=1; l<=depth; l++){
+      levelStart[l+1]=flipFlops+uint64_t(gates)*l/depth;
+   }
+
+   input->xorGateInputs.resize(gates);
+   for(unsigned l=1; l<=depth; l++){
+      for(unsigned s=levelStart[l]; s<levelStart[l+1]; s++){
+         unsigned below=levelStart[l-1]+rnd()%(levelStart[l]-levelStart[l-1]);
+         unsigned any=rnd()%levelStart[l];
+         if(rnd()&1)
+            std::swap(below, any);
+         input->xorGateInputs[s-flipFlops]=std::make_pair(int32_t(below), int32_t(any));
+      }
+   }
+
+   input->flipFlopInputs.resize(flipFlops);
+   input->inputState.resize(flipFlops);
+   unsigned total=flipFlops+gates;
+   for(unsigned i=0; i<flipFlops; i++){
+      if(gates>0 && (rnd()&1)){
+         input->flipFlopInputs[i]=levelStart[depth]+rnd()%(total-levelStart[depth]);
+      }else{
+         input->flipFlopInputs[i]=rnd()%total;
+      }
+      input->inputState.Set(i, rnd()&1);
+   }
+
+   return input;
+}
+
+int main(int argc, char *argv[])
+{
+   puzzler::PuzzleRegistrar::UserRegisterPuzzles();
+
+   if(argc<5){
+      fprintf(stderr, "bench_logic_sim flipFlops gates depth cycles [engines] [logLevel]\n");
+      fprintf(stderr, "  engines is a comma separated list, default memo,compiled,masks,gf2\n");
+      exit(1);
+   }
+
+   try{
+      unsigned flipFlops=atoi(argv[1]);
+      unsigned gates=atoi(argv[2]);
+      unsigned depth=atoi(argv[3]);
+      unsigned cycles=atoi(argv[4]);
+      std::string engineList = argc>5 ? argv[5] : "memo,compiled,masks,gf2";
+      int logLevel = argc>6 ? atoi(argv[6]) : 1;
+
+      if(flipFlops==0)
+         throw std::runtime_error("Need at least one flip-flop.");
+
+      std::shared_ptr<puzzler::ILog> logDest=std::make_shared<puzzler::LogDest>("bench_logic_sim", logLevel);
+
+      LogicSimProvider provider;
+      auto input=MakeInput(&provider, flipFlops, gates, depth, cycles, 1);
+
+      std::vector<std::string> engines;
+      std::stringstream list(engineList);
+      std::string engine;
+      while(std::getline(list, engine, ',')){
+         engines.push_back(engine);
+      }
+
+      // The reference walks every fan-in cone as a tree, so its cost is up to
+      // 2^depth per flip-flop per cycle. Only check against it when that is
+      // small, otherwise check every engine against the first one.
+      double referenceCost=double(flipFlops)*cycles*std::pow(2.0, std::min(depth, 60u));
+      puzzler::BitVector expected;
+      std::string checkedBy;
+      if(referenceCost <= 1e8){
+         LogicSimNetlist unused;
+         expected=provider.RunEngine(logDest.get(), "reference", input.get(), unused);
+         checkedBy="reference";
+      }
+
+      puzzler::timestamp_t begin=puzzler::now();
+      LogicSimNetlist netlist;
+      netlist.Compile(input.get());
+      double compileTime=(puzzler::now()-begin)*1e-9;
+
+      printf("# flipFlops=%u gates=%u depth=%u cycles=%u\n", flipFlops, gates, depth, cycles);
+      printf("# compiled: %u of %u gates live, %u levels, %.6fs\n", (unsigned)netlist.gates.size(), gates, (unsigned)netlist.levelStarts.size()-1, compileTime);
+      printf("%-10s %12s %12s  %s\n", "engine", "compile(s)", "run(s)", "check");
+
+      bool failed=false;
+      for(const std::string &e : engines){
+         // memo and reference work from the input, so don't pay for compiling
+         bool usesNetlist = e!="memo" && e!="reference";
+
+         begin=puzzler::now();
+         puzzler::BitVector got=provider.RunEngine(logDest.get(), e, input.get(), netlist);
+         double runTime=(puzzler::now()-begin)*1e-9;
+
+         std::string check;
+         if(checkedBy.empty()){
+            expected=got;
+            checkedBy=e;
+            check="baseline";
+         }else if(got==expected){
+            check="ok vs "+checkedBy;
+         }else{
+            check="MISMATCH vs "+checkedBy;
+            failed=true;
+         }
+         printf("%-10s %12.6f %12.6f  %s\n", e.c_str(), usesNetlist ? compileTime : 0.0, runTime, check.c_str());
+      }
+
+      if(failed)
+         return 1;
+
+   }catch(std::string &msg){
+      std::cerr<<"Caught error string : "<<msg<<std::endl;
+      return 1;
+   }catch(std::exception &e){
+      std::cerr<<"Caught exception : "<<e.what()<<std::endl;
+      return 1;
+   }catch(...){
+      std::cerr<<"Caught unknown exception."<<std::endl;
+      return 1;
+   }
+
+   return 0;
+}
@@ -3,6 +3,48 @@
 
 #include <iostream>
 
+/* True if fileName starts like an output of a puzzle whose outputs can be
+   compared by hash, and sets its name. Anything else just returns false, and
+   loading it will report it properly. */
+static bool IsExactOutput(const std::string &fileName, std::string &puzzleName)
+{
+   try{
+      puzzler::MmapInStream src(fileName);
+      puzzler::CompressedInStream in(&src);
+      std::string format;
+      puzzler::PersistContext ctxt(&in, false);
+      ctxt.SendOrRecv(format).SendOrRecv(puzzleName);
+      if(format!="puzzle.output.v0" && format!="puzzle.output.v1")
+         return false;
+      auto puzzle=puzzler::PuzzleRegistrar::Lookup(puzzleName);
+      return puzzle && puzzle->OutputsAreExact();
+   }catch(std::exception &){
+      return false;
+   }
+}
+
+/* Sets hash from the trailer of fileName (mapped as src) if it has one. For
+   a plain file that is the last few bytes, but a compressed one has to be
+   decompressed to the end to find it. If verify is set, the file is hashed
+   in the same pass and this throws if it doesn't match its trailer. */
+static bool ReadHashTrailer(const std::string &fileName, const puzzler::MmapInStream &src, bool compressed, bool verify, uint64_t &hash)
+{
+   try{
+      if(!compressed){
+         if(verify)
+            return puzzler::CheckHashTrailer(src.Data(), src.Size(), hash);
+         return src.Size()>=puzzler::HashTrailerSize
+            && puzzler::ParseHashTrailer(src.Data()+src.Size()-puzzler::HashTrailerSize, src.Size(), hash);
+      }
+      // The trailer covers the uncompressed bytes from the very start
+      puzzler::MmapInStream whole(fileName);
+      puzzler::CompressedInStream wholeIn(&whole);
+      return puzzler::RecvHashTrailer(&wholeIn, hash, verify);
+   }catch(std::exception &e){
+      throw std::runtime_error("File '"+fileName+"' is corrupt : "+e.what());
+   }
+}
+
 
 int main(int argc, char *argv[])
 {
@@ -10,6 +52,8 @@ int main(int argc, char *argv[])
 
    if(argc<2){
       fprintf(stderr, "compare_puzzle_output ref got logLevel\n");
+      fprintf(stderr, "  either file may be compressed, e.g. by execute_puzzle --compress\n");
+      fprintf(stderr, "  outputs written with execute_puzzle --hash are compared by hash where possible\n");
       std::cout<<"Puzzles:\n";
       puzzler::PuzzleRegistrar::ListPuzzles();
       exit(1);
@@ -27,11 +71,69 @@ int main(int argc, char *argv[])
       std::shared_ptr<puzzler::ILog> logDest=std::make_shared<puzzler::LogDest>("execute_puzzle", logLevel);
       logDest->Log(puzzler::Log_Info, "Created log.");
 
+      // Map both files, so loading them is a memcpy from the page cache and
+      // identical files can be compared without decoding them at all.
+      puzzler::MmapInStream refSrc(refName);
+      puzzler::MmapInStream gotSrc(gotName);
+      // Either may be compressed
+      puzzler::CompressedInStream refIn(&refSrc);
+      puzzler::CompressedInStream gotIn(&gotSrc);
+
+      /* Matching hashes are enough if identical bytes mean equal outputs,
+         and only need the file under test to be hashed, as the reference is
+         trusted. Different hashes go straight to loading both, which also
+         gives the puzzle a chance to report. Plain files show whether they
+         have a trailer for free, so the hashes are only looked at if both
+         might have one and they are outputs of the same exact puzzle. */
+      bool refCompressed=refIn.IsCompressed(), gotCompressed=gotIn.IsCompressed();
+      uint64_t refHash=0, gotHash=0;
+      bool refTrailer=!refCompressed && ReadHashTrailer(refName, refSrc, false, false, refHash);
+      bool gotTrailer=!gotCompressed && ReadHashTrailer(gotName, gotSrc, false, false, gotHash);
+      bool useHashes=false;
+      if((refTrailer || refCompressed) && (gotTrailer || gotCompressed)){
+         std::string refPuzzle, gotPuzzle;
+         useHashes=IsExactOutput(refName, refPuzzle) && IsExactOutput(gotName, gotPuzzle) && refPuzzle==gotPuzzle;
+      }
+
+      bool identical=false, hashesMatch=false;
+      if(useHashes && refTrailer && gotTrailer){
+         // Both trailers were free, so they decide it
+         hashesMatch = refHash==gotHash && ReadHashTrailer(gotName, gotSrc, false, true, gotHash);
+      }else{
+         identical=refSrc.Size()==gotSrc.Size() && (refSrc.Size()==0 || 0==memcmp(refSrc.Data(), gotSrc.Data(), refSrc.Size()));
+         if(!identical && useHashes && (refTrailer || ReadHashTrailer(refName, refSrc, true, false, refHash))){
+            // A plain got with a different trailer can't match, otherwise hash it
+            if(!gotTrailer || gotHash==refHash)
+               hashesMatch=ReadHashTrailer(gotName, gotSrc, gotCompressed, true, gotHash) && gotHash==refHash;
+         }
+      }
+
+      if(identical){
+         // Still check that it is a valid output for a known puzzle
+         std::string format, name;
+         puzzler::PersistContext ctxt(&refIn, false);
+         ctxt.SendOrRecv(format).SendOrRecv(name);
+         if(format!="puzzle.output.v0" && format!="puzzle.output.v1")
+            throw std::runtime_error("Not a puzzle output.");
+         if(!puzzler::PuzzleRegistrar::Lookup(name))
+            throw std::runtime_error("No handler for puzzle type '"+name+"'");
+         logDest->LogInfo("Outputs are byte-identical.");
+         logDest->LogInfo("Outputs are equal.");
+         return 0;
+      }
+      if(hashesMatch){
+         logDest->LogInfo("Output hashes match.");
+         logDest->LogInfo("Outputs are equal.");
+         return 0;
+      }
+      if(useHashes){
+         logDest->LogVerbose("Output hashes differ, loading outputs.");
+      }
+
       logDest->LogInfo("Loading reference %s", refName.c_str());
       std::shared_ptr<puzzler::Puzzle::Output> ref;
       {
-         puzzler::FileInStream src(refName);
-         puzzler::PersistContext ctxt(&src, false);
+         puzzler::PersistContext ctxt(&refIn, false);
 
          ref=puzzler::PuzzleRegistrar().LoadOutput(ctxt);
       }
@@ -39,8 +141,7 @@ int main(int argc, char *argv[])
       logDest->LogInfo("Loading got %s", gotName.c_str());
       std::shared_ptr<puzzler::Puzzle::Output> got;
       {
-         puzzler::FileInStream src(gotName);
-         puzzler::PersistContext ctxt(&src, false);
+         puzzler::PersistContext ctxt(&gotIn, false);
 
          got=puzzler::PuzzleRegistrar().LoadOutput(ctxt);
       }
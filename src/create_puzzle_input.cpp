@@ -8,8 +8,23 @@ int main(int argc, char *argv[])
 {
    puzzler::PuzzleRegistrar::UserRegisterPuzzles();
 
+   // Options may appear anywhere, and the remaining arguments are positional
+   bool compress=false;
+   std::vector<char*> args;
+   for(int i=0; i<argc; i++){
+      if(std::string(argv[i])=="--compress"){
+         compress=true;
+      }else{
+         args.push_back(argv[i]);
+      }
+   }
+   argc=args.size();
+   argv=&args[0];
+
    if(argc<2){
-      fprintf(stderr, "create_puzzle_input name scale logLevel\n");
+      fprintf(stderr, "create_puzzle_input name scale logLevel [format] [--compress]\n");
+      fprintf(stderr, "  format is v0 (big-endian, the default) or v1 (native byte order)\n");
+      fprintf(stderr, "  --compress : compress the output\n");
       std::cout<<"Puzzles:\n";
       puzzler::PuzzleRegistrar::ListPuzzles();
       exit(1);
@@ -34,12 +49,28 @@ int main(int argc, char *argv[])
 
       logDest->LogInfo("Creating random input");
       auto input=puzzle->CreateInput(logDest.get(), scale);
+      if(argc>4){
+         std::string format=argv[4];
+         if(format!="v0" && format!="v1")
+            throw std::runtime_error("Unknown format "+format);
+         input->SetNativeFormat(format=="v1");
+      }
 
       logDest->LogInfo("Writing data to stdout");
       {
-         puzzler::StdoutStream dst;
-         puzzler::PersistContext ctxt(&dst, true);
+         puzzler::StdoutStream raw;
+         puzzler::BufferedOutStream buffered(&raw);
+         std::unique_ptr<puzzler::CompressedOutStream> compressed;
+         puzzler::Stream *dst=&buffered;
+         if(compress){
+            compressed.reset(new puzzler::CompressedOutStream(&buffered));
+            dst=compressed.get();
+         }
+         puzzler::PersistContext ctxt(dst, true);
          input->Persist(ctxt);
+         if(compressed)
+            compressed->Finish();
+         buffered.Flush();
       }
    }catch(std::string &msg){
       std::cerr<<"Caught error string : "<<msg<<std::endl;
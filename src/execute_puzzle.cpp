@@ -8,8 +8,28 @@ int main(int argc, char *argv[])
 {
    puzzler::PuzzleRegistrar::UserRegisterPuzzles();
 
+   // Options may appear anywhere, and the remaining arguments are positional
+   bool compress=false, hash=false, stream=false;
+   std::vector<char*> args;
+   for(int i=0; i<argc; i++){
+      if(std::string(argv[i])=="--compress"){
+         compress=true;
+      }else if(std::string(argv[i])=="--hash"){
+         hash=true;
+      }else if(std::string(argv[i])=="--stream"){
+         stream=true;
+      }else{
+         args.push_back(argv[i]);
+      }
+   }
+   argc=args.size();
+   argv=&args[0];
+
    if(argc<2){
-      fprintf(stderr, "execute_puzzle isReference logLevel\n");
+      fprintf(stderr, "execute_puzzle isReference logLevel [--compress] [--hash] [--stream]\n");
+      fprintf(stderr, "  --compress : compress the output (compressed input is detected automatically)\n");
+      fprintf(stderr, "  --hash : append a hash of the output, so compare_puzzle_output can skip loading it\n");
+      fprintf(stderr, "  --stream : write the output while it is computed, if the puzzle supports it (ignored for the reference)\n");
       exit(1);
    }
 
@@ -22,7 +42,16 @@ int main(int argc, char *argv[])
 
       std::shared_ptr<puzzler::Puzzle::Input> input;
       {
-         puzzler::StdinStream src;
+         // When stdin is a file it is mapped, so large arrays can be decoded
+         // straight out of the page cache (see PersistContext::RecvWords)
+         std::unique_ptr<puzzler::Stream> raw, base;
+         if(puzzler::MmapInStream::IsMappable(STDIN_FILENO)){
+            base.reset(new puzzler::MmapInStream(STDIN_FILENO));
+         }else{
+            raw.reset(new puzzler::StdinStream());
+            base.reset(new puzzler::BufferedInStream(raw.get()));
+         }
+         puzzler::CompressedInStream src(base.get());
          puzzler::PersistContext ctxt(&src, false);
 
          input=puzzler::PuzzleRegistrar().LoadInput(ctxt);
@@ -32,23 +61,47 @@ int main(int argc, char *argv[])
 
       auto puzzle=puzzler::PuzzleRegistrar().Lookup(input->PuzzleName());
 
-      auto output=puzzle->MakeEmptyOutput(input.get());
-
-      if(isReference){
-         logDest->LogInfo("Begin reference");
-         puzzle->ReferenceExecute(logDest.get(), input.get(), output.get());
-         logDest->LogInfo("Finished reference");
-      }else{
-         logDest->LogInfo("Begin execution");
-         puzzle->Execute(logDest.get(), input.get(), output.get());
-         logDest->LogInfo("Finished execution");
-      }
-
       {
-         puzzler::StdoutStream dst;
-         puzzler::PersistContext ctxt(&dst, true);
-
-         output->Persist(ctxt);
+         puzzler::StdoutStream raw;
+         puzzler::BufferedOutStream buffered(&raw);
+         std::unique_ptr<puzzler::CompressedOutStream> compressed;
+         puzzler::Stream *dst=&buffered;
+         if(compress){
+            compressed.reset(new puzzler::CompressedOutStream(&buffered));
+            dst=compressed.get();
+         }
+         std::unique_ptr<puzzler::HashingOutStream> hashing;
+         if(hash){
+            hashing.reset(new puzzler::HashingOutStream(dst));
+            dst=hashing.get();
+         }
+         puzzler::PersistContext ctxt(dst, true);
+
+         // The output stream is opened first, so a streaming puzzle can write to it as it goes
+         if(stream && !isReference){
+            logDest->LogInfo("Begin streamed execution");
+            puzzle->ExecuteToStream(logDest.get(), input.get(), ctxt);
+            logDest->LogInfo("Finished streamed execution");
+         }else{
+            auto output=puzzle->MakeEmptyOutput(input.get());
+
+            if(isReference){
+               logDest->LogInfo("Begin reference");
+               puzzle->ReferenceExecute(logDest.get(), input.get(), output.get());
+               logDest->LogInfo("Finished reference");
+            }else{
+               logDest->LogInfo("Begin execution");
+               puzzle->Execute(logDest.get(), input.get(), output.get());
+               logDest->LogInfo("Finished execution");
+            }
+
+            output->Persist(ctxt);
+         }
+         if(hashing)
+            hashing->SendTrailer();
+         if(compressed)
+            compressed->Finish();
+         buffered.Flush();
       }
 
    }catch(std::string &msg){
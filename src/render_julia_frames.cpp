@@ -0,0 +1,76 @@
+
+#include "puzzler/puzzler.hpp"
+#include "puzzler/puzzles/julia.hpp"
+
+#include <iostream>
+
+
+int main(int argc, char *argv[])
+{
+   puzzler::PuzzleRegistrar::UserRegisterPuzzles();
+
+   if(argc<8){
+      fprintf(stderr, "render_julia_frames width height maxIter tBegin tEnd frames logLevel\n");
+      exit(1);
+   }
+
+   try{
+      unsigned width=atoi(argv[1]);
+      unsigned height=atoi(argv[2]);
+      unsigned maxIter=atoi(argv[3]);
+      float tBegin=atof(argv[4]);
+      float tEnd=atof(argv[5]);
+      unsigned frames=atoi(argv[6]);
+
+      // Control how much is being output.
+      // Higher numbers give you more info
+      int logLevel=atoi(argv[7]);
+      fprintf(stderr, "LogLevel = %s -> %d\n", argv[7], logLevel);
+
+      std::shared_ptr<puzzler::ILog> logDest=std::make_shared<puzzler::LogDest>("render_julia_frames", logLevel);
+      logDest->Log(puzzler::Log_Info, "Created log.");
+
+      auto puzzle=std::dynamic_pointer_cast<puzzler::JuliaPuzzle>(puzzler::PuzzleRegistrar::Lookup("julia"));
+      if(!puzzle)
+         throw std::runtime_error("No julia puzzle registered.");
+
+      std::vector<std::shared_ptr<puzzler::JuliaInput> > inputHolders;
+      std::vector<std::shared_ptr<puzzler::Puzzle::Output> > holders;
+      std::vector<const puzzler::JuliaInput*> inputs;
+      std::vector<puzzler::JuliaOutput*> outputs;
+      for(unsigned i=0; i<frames; i++){
+         float t = frames>1 ? tBegin+(tEnd-tBegin)*i/(frames-1) : tBegin;
+         inputHolders.push_back(puzzle->CreateFrameInput(width, height, maxIter, t));
+         holders.push_back(puzzle->MakeEmptyOutput(inputHolders.back().get()));
+         inputs.push_back(inputHolders.back().get());
+         outputs.push_back(puzzler::As<puzzler::JuliaOutput>(holders.back().get()));
+      }
+
+      // Frames are written back to back on stdout, each as a normal julia output
+      puzzler::StdoutStream raw;
+      puzzler::BufferedOutStream dst(&raw);
+      puzzler::PersistContext ctxt(&dst, true);
+
+      logDest->LogInfo("Rendering %u frames", frames);
+      puzzle->ExecuteBatch(logDest.get(), inputs, outputs, [&](unsigned i){
+         outputs[i]->Persist(ctxt);
+         dst.Flush();
+         // Release the frame as soon as it is written
+         std::vector<uint8_t>().swap(outputs[i]->pixels);
+      });
+      logDest->LogInfo("Finished");
+
+   }catch(std::string &msg){
+      std::cerr<<"Caught error string : "<<msg<<std::endl;
+      return 1;
+   }catch(std::exception &e){
+      std::cerr<<"Caught exception : "<<e.what()<<std::endl;
+      return 1;
+   }catch(...){
+      std::cerr<<"Caught unknown exception."<<std::endl;
+      return 1;
+   }
+
+   return 0;
+}
+